@@ -194,13 +194,14 @@ Qt::ItemFlags DatabaseModel::flags(const QModelIndex& index) const {
   return flags;
 }
 
-void DatabaseModel::removeIndexes(const QModelIndexList& indexes) {
+void DatabaseModel::removeIndexes(const QModelIndexList& indexes,
+                                  bool fromDatabase) {
   QList<int> rows;
   for (const auto& index : indexes) rows << index.row();
-  removeRows(rows);
+  removeRows(rows, fromDatabase);
 }
 
-void DatabaseModel::removeRows(QList<int>& rows) {
+void DatabaseModel::removeRows(QList<int>& rows, bool fromDatabase) {
   // go from highest to lowest so the row numbers stay valid
   std::sort(rows.begin(), rows.end(), std::greater<int>());
 
@@ -218,7 +219,7 @@ void DatabaseModel::removeRows(QList<int>& rows) {
     }
     beginRemoveRows(QModelIndex(), group.back(), group.front());
     for (int row : group) {
-      deleteIndex(index(row, 0));
+      if (fromDatabase) deleteIndex(index(row, 0));
       items_.removeAt(row);
     }
     endRemoveRows();
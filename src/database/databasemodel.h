@@ -66,11 +66,12 @@ class DatabaseModel : public QAbstractTableModel {
   Qt::ItemFlags flags(const QModelIndex& index) const override;
 
   virtual void clear();
-  //! remove the given row numbers from the model AND from the database
   void setWhere(const QString& where);
   void rowAdded();
-  void removeRows(QList<int>& rows);
-  void removeIndexes(const QModelIndexList& indexes);
+  /*! remove the given row numbers from the model, and from the database unless
+    `fromDatabase` is false. */
+  void removeRows(QList<int>& rows, bool fromDatabase = true);
+  void removeIndexes(const QModelIndexList& indexes, bool fromDatabase = true);
   const QString primaryKey(const QModelIndex& index) const;
   void deleteIndex(const QModelIndex& index);
   void refreshAll();
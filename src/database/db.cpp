@@ -21,25 +21,30 @@
 #include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
+#include <QHash>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QSettings>
 #include <QStandardPaths>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <map>
 #include <memory>
+#include <random>
 #include <utility>
 #include <vector>
 
 #include <sqlite3pp.h>
 #include <QsLog.h>
 
+#include "database/migrations.h"
 #include "defs.h"
 #include "generators/generate.h"
 #include "quizzer/test.h"
 #include "texts/text.h"
+#include "texts/textanalysis.h"
 
 using std::nth_element;
 using std::max_element;
@@ -55,21 +60,156 @@ using sqlite3pp::statement;
 
 static QMutex db_lock;
 
-static double median(vector<double>& v) {
-  if (v.empty()) return 0.0;
-  auto n = v.size() / 2;
-  nth_element(v.begin(), v.begin() + n, v.end());
-  auto med = v[n];
-  if (!(v.size() & 1)) {
-    auto max_it = max_element(v.begin(), v.begin() + n);
+// how long a connection waits for another one that is writing, archiving or
+// merging a large profile can take a while.
+static const int kBusyTimeout = 60000;
+
+/*! A transaction that takes the write lock when it begins, so it waits for
+  other writers through the busy timeout. A deferred transaction that read
+  first fails at its first write instead. */
+class write_transaction : public transaction {
+ public:
+  explicit write_transaction(database& db) : transaction(db, false, true) {}
+};
+
+//! commit `xct`, rolling it back and throwing if that fails.
+static void commit(transaction* xct, database& db) {
+  if (xct->commit() == SQLITE_OK) return;
+  sqlite3pp::database_error error(db);
+  db.execute("ROLLBACK");
+  throw error;
+}
+
+static const char* const kInsertStatistic =
+    "INSERT INTO statistic "
+    "(time, viscosity, count, mistakes, ngram, w, result_id) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?)";
+static const char* const kInsertMistake =
+    "INSERT INTO mistake (target, mistake, count, w, result_id) "
+    "VALUES (?, ?, ?, ?, ?)";
+static const char* const kInsertKeyTiming =
+    "INSERT INTO key_timing "
+    "(result_id, ngram, count, dwell, flight, overlaps) "
+    "VALUES (?, ?, ?, ?, ?, ?)";
+static const char* const kInsertReview =
+    "INSERT OR REPLACE INTO review (ngram, due, interval, ease, reps, lapses) "
+    "VALUES (?, ?, ?, ?, ?, ?)";
+static std::atomic<bool> read_only_profile(false);
+
+//! the median of [first, last), which is partially reordered.
+static double median(double* first, double* last) {
+  if (first == last) return 0.0;
+  auto size = last - first;
+  auto n = size / 2;
+  nth_element(first, first + n, last);
+  auto med = first[n];
+  if (!(size & 1)) {
+    auto max_it = max_element(first, first + n);
     med = (*max_it + med) / 2.0;
   }
   return med;
 }
 
+static double median(vector<double>& v) {
+  return median(v.data(), v.data() + v.size());
+}
+
+static int ngramType(const QString& ngram) {
+  if (ngram.length() == 1)
+    return static_cast<int>(amphetype::statistics::Type::Keys);
+  else if (ngram.length() == 3)
+    return static_cast<int>(amphetype::statistics::Type::Trigrams);
+  else
+    return static_cast<int>(amphetype::statistics::Type::Words);
+}
+
+/*! In memory copy of the ngram table of a profile, shared by every Database
+  opened on it so that saving statistics rarely has to look ids up. */
+class NgramDictionary {
+ public:
+  long long find(const QPair<int, QString>& key) const {
+    QMutexLocker locker(&lock_);
+    return ids_.value(key, -1);
+  }
+  void insert(const ngram_ids& ids) {
+    QMutexLocker locker(&lock_);
+    for (auto it = ids.begin(); it != ids.end(); ++it)
+      ids_.insert(it.key(), it.value());
+  }
+
+ private:
+  mutable QMutex lock_;
+  ngram_ids ids_;
+};
+
+static shared_ptr<NgramDictionary> ngramDictionary(const QString& path) {
+  // every connection to :memory: is a different database.
+  if (path == ":memory:") return make_shared<NgramDictionary>();
+  static QMutex lock;
+  static map<QString, shared_ptr<NgramDictionary>> dictionaries;
+  QMutexLocker locker(&lock);
+  auto& dictionary = dictionaries[path];
+  if (!dictionary) dictionary = make_shared<NgramDictionary>();
+  return dictionary;
+}
+
+//! the RecentResults of a profile, shared like its NgramDictionary.
+static shared_ptr<RecentResults> recentResults(const QString& path) {
+  if (path == ":memory:") return make_shared<RecentResults>();
+  static QMutex lock;
+  static map<QString, shared_ptr<RecentResults>> recent;
+  QMutexLocker locker(&lock);
+  auto& results = recent[path];
+  if (!results) results = make_shared<RecentResults>();
+  return results;
+}
+
+//! the ResultRanks of a profile, shared like its NgramDictionary.
+static shared_ptr<ResultRanks> resultRanks(const QString& path) {
+  if (path == ":memory:") return make_shared<ResultRanks>();
+  static QMutex lock;
+  static map<QString, shared_ptr<ResultRanks>> ranks;
+  QMutexLocker locker(&lock);
+  auto& results = ranks[path];
+  if (!results) results = make_shared<ResultRanks>();
+  return results;
+}
+
+//! the TextIndex of a profile, shared like its NgramDictionary.
+static shared_ptr<TextIndex> textIndex(const QString& path) {
+  if (path == ":memory:") return make_shared<TextIndex>();
+  static QMutex lock;
+  static map<QString, shared_ptr<TextIndex>> indexes;
+  QMutexLocker locker(&lock);
+  auto& index = indexes[path];
+  if (!index) index = make_shared<TextIndex>();
+  return index;
+}
+
+//! the ReviewSchedule of a profile, shared like its NgramDictionary.
+static shared_ptr<ReviewSchedule> reviewSchedule(const QString& path) {
+  if (path == ":memory:") return make_shared<ReviewSchedule>();
+  static QMutex lock;
+  static map<QString, shared_ptr<ReviewSchedule>> schedules;
+  QMutexLocker locker(&lock);
+  auto& schedule = schedules[path];
+  if (!schedule) schedule = make_shared<ReviewSchedule>();
+  return schedule;
+}
+
 namespace sqlite_extensions {
 double sql_pow(double x, double y) { return pow(x, y); }
 
+// 64 bit FNV-1a, to compare texts without comparing their contents.
+long long text_hash(char const* text) {
+  unsigned long long hash = 14695981039346656037ULL;
+  for (; text && *text; ++text) {
+    hash ^= static_cast<unsigned char>(*text);
+    hash *= 1099511628211ULL;
+  }
+  return static_cast<long long>(hash);
+}
+
 struct agg_median {
   void step(double x) { v.push_back(x); }
   double finish() { return median(v); }
@@ -77,27 +217,82 @@ struct agg_median {
 };
 };  // namespace sqlite_extensions
 
-DBConnection::DBConnection(const QString& path)
+DBConnection::DBConnection(const QString& path, const QString& archive)
     : db_(path.toStdString().data()), func_(db_), aggr_(db_) {
   func_.create<double(double, double)>("pow", &sqlite_extensions::sql_pow);
+  func_.create<long long(char const*)>("text_hash",
+                                       &sqlite_extensions::text_hash);
   aggr_.create<sqlite_extensions::agg_median, double>("agg_median");
+  db_.set_busy_timeout(kBusyTimeout);
   db_.execute("PRAGMA foreign_keys = ON");
   db_.execute("PRAGMA journal_mode = WAL");
+  if (!archive.isEmpty() && QFileInfo::exists(archive)) {
+    try {
+      attachArchive(archive);
+    } catch (const exception& e) {
+      QLOG_ERROR() << "can't attach archive" << archive << e.what();
+    }
+  }
+  // after the archive, its views are temporary and need writing too.
+  if (read_only_profile) db_.execute("PRAGMA query_only = ON");
 }
 
 database& DBConnection::db() { return db_; }
+bool DBConnection::archived() const { return archived_; }
+
+void DBConnection::attachArchive(const QString& path) {
+  if (archived_) return;
+  if (db_.attach(path.toUtf8().constData(), "archive") != SQLITE_OK)
+    throw sqlite3pp::database_error(db_);
+  db_.execute("PRAGMA archive.journal_mode = WAL");
+  migrations::createArchive(db_);
+  migrations::createHistoryViews(db_);
+  archived_ = true;
+}
 
-Database::Database(const QString& name) {
-  auto db_path = make_db_path(name);
+Database::Database(const QString& name)
+    : path_(make_db_path(name)),
+      ngrams_(ngramDictionary(path_)),
+      recent_(::recentResults(path_)),
+      ranks_(::resultRanks(path_)),
+      index_(::textIndex(path_)),
+      reviews_(::reviewSchedule(path_)) {
   QMutexLocker locker(&db_lock);
-  conn_ = make_unique<DBConnection>(db_path);
+  conn_ = make_unique<DBConnection>(path_, archivePath());
+}
+
+QString Database::resultTable() const {
+  return conn_->archived() ? "resultHistory" : "result";
 }
 
+QString Database::latestResults() const {
+  // each table is walked back along its w index, rather than sorting the
+  // whole history view.
+  QString latest =
+      "SELECT * FROM (SELECT w, wpm, accuracy, viscosity FROM %1.result "
+      "ORDER BY w DESC LIMIT ?1)";
+  if (!conn_->archived()) return latest.arg("main");
+  return QString("SELECT * FROM (%1 UNION ALL %2) ORDER BY w DESC LIMIT ?1")
+      .arg(latest.arg("main"), latest.arg("archive"));
+}
+
+static QString archive_path(const QString& path) {
+  if (path == ":memory:") return QString();
+  QFileInfo profile(path);
+  return profile.absolutePath() + "/" + profile.completeBaseName() +
+         ".archive";
+}
+
+QString Database::archivePath() const { return archive_path(path_); }
+
 QString Database::make_db_path(const QString& name) {
   auto path =
       QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
       "/%1.profile";
-  if (!name.isNull()) return (name == ":memory:") ? name : path.arg(name);
+  if (!name.isNull()) {
+    if (name == ":memory:" || QFileInfo(name).isAbsolute()) return name;
+    return path.arg(name);
+  }
 
   QSettings s;
   QFileInfo check = path.arg(s.value("profile", "default").toString());
@@ -109,118 +304,88 @@ QString Database::make_db_path(const QString& name) {
   }
 }
 
-void Database::initDB() {
+bool Database::initDB() {
+  auto tables =
+      getOneRow("SELECT count() FROM sqlite_master WHERE type = 'table'");
+  // a brand new profile has no data, so nothing needs to wait.
+  bool fresh = schemaVersion() == 0 && !tables.empty() && !tables[0].toInt();
+  return migrate(fresh);
+}
+
+int Database::schemaVersion() const {
+  auto row = getOneRow("PRAGMA user_version");
+  return row.empty() ? 0 : row[0].toInt();
+}
+
+void Database::setReadOnly(bool read_only) { read_only_profile = read_only; }
+bool Database::readOnly() { return read_only_profile; }
+
+bool Database::migrate(bool background,
+                       const std::function<void(int)>& progress) {
+  auto& db = conn_->db();
   try {
-    transaction xct(conn_->db());
-    {
-      conn_->db().execute(
-          "CREATE TABLE IF NOT EXISTS source("
-          "id         INTEGER PRIMARY KEY,"
-          "name       TEXT,"
-          "disabled   INTEGER,"
-          "discount   INTEGER,"
-          "type       INTEGER,"
-          "text_count INTEGER)");
-      conn_->db().execute(
-          "CREATE TABLE IF NOT EXISTS text("
-          "id       INTEGER PRIMARY KEY,"
-          "source   INTEGER REFERENCES source(id) ON DELETE CASCADE,"
-          "text     TEXT,"
-          "disabled INTEGER)");
-      conn_->db().execute(
-          "CREATE TABLE IF NOT EXISTS result("
-          "id        INTEGER PRIMARY KEY,"
-          "w         DATETIME,"
-          "text_id   INTEGER REFERENCES text(id) ON DELETE CASCADE,"
-          "source    INTEGER REFERENCES source(id),"
-          "wpm       REAL,"
-          "accuracy  REAL,"
-          "viscosity REAL)");
-      conn_->db().execute(
-          "CREATE TABLE IF NOT EXISTS statistic("
-          "w         DATETIME,"
-          "data      TEXT,"
-          "type      INTEGER,"
-          "time      REAL,"
-          "count     INTEGER,"
-          "mistakes  INTEGER,"
-          "viscosity REAL)");
-      conn_->db().execute(
-          "CREATE TABLE IF NOT EXISTS mistake("
-          "w       DATETIME,"
-          "target  TEXT,"
-          "mistake TEXT,"
-          "count   INTEGER)");
-
-      conn_->db().execute(
-          "DROP VIEW IF EXISTS performanceView; "
-          "CREATE VIEW performanceView as SELECT "
-          "result.id,"
-          "text_id,"
-          "source.id as source_id,"
-          "w as date,"
-          "source.name as source_name,"
-          "source.type,"
-          "wpm,"
-          "100.0 * accuracy as accuracy,"
-          "viscosity "
-          "FROM result "
-          "LEFT JOIN source ON (result.source = source.id)");
-
-      conn_->db().execute(
-          "DROP VIEW IF EXISTS sourceView; "
-          "CREATE VIEW sourceView as "
-          "SELECT source.id, name as name_editable, text_count as Texts, "
-          " count(wpm) as Results, nullif(round(agg_median(wpm), 1), 0) as "
-          "WPM, "
-          " disabled as Disabled, type as Type "
-          "FROM source "
-          "LEFT JOIN result ON (source.id = result.source) "
-          "GROUP BY source.id");
-
-      conn_->db().execute(
-          "DROP VIEW IF EXISTS textView; "
-          "CREATE VIEW textView as "
-          "SELECT text.id, "
-          " substr(text, 0, 30) || '...' as text_editable, "
-          " length(text) as length, count(wpm) as results, "
-          " nullif(round(agg_median(wpm), 1), 0) as wpm, "
-          " (CASE WHEN disabled = 1 THEN 'yes' ELSE NULL END) as disabled, "
-          " text.source as source "
-          "FROM text "
-          "LEFT JOIN result ON (text.id = result.text_id) "
-          "GROUP BY text.id");
-
-      conn_->db().execute(
-          "CREATE TRIGGER text_count_add_trigger BEFORE INSERT ON text "
-          "FOR EACH ROW "
-          "BEGIN "
-          "  UPDATE source set text_count = text_count + 1 where id = "
-          "  NEW.source; "
-          "END;");
-      conn_->db().execute(
-          "CREATE TRIGGER text_count_subtract_trigger BEFORE DELETE ON text "
-          "FOR EACH ROW "
-          "BEGIN "
-          "  UPDATE source set text_count = text_count - 1 where id = "
-          "  OLD.source; "
-          "END;");
-      conn_->db().execute(
-          "CREATE TRIGGER invalidate_result_trigger AFTER UPDATE OF text ON "
-          "text "
-          "FOR EACH ROW "
-          "BEGIN "
-          "  UPDATE result set source = NULL, text_id = NULL where text_id = "
-          "  NEW.id; "
-          "END;");
+    db.execute("PRAGMA query_only = OFF");
+    db.execute(
+        "CREATE TABLE IF NOT EXISTS migration_state("
+        "version INTEGER PRIMARY KEY,"
+        "cursor  INTEGER)");
+
+    int version = schemaVersion();
+    vector<const migrations::Migration*> pending;
+    for (const auto& m : migrations::all())
+      if (m.version > version) pending.push_back(&m);
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+      const auto& m = *pending[i];
+      if (m.background && !background) {
+        createViews();
+        return false;
+      }
+      auto saved = getOneRow(
+          "SELECT cursor FROM migration_state WHERE version = ?", m.version);
+      long long cursor = saved.empty() ? 0 : saved[0].toLongLong();
+      long long size = m.size ? m.size(db) : 0;
+      QLOG_INFO() << "Database::migrate - version" << m.version
+                  << m.description << "from" << cursor;
+
+      command save(db, "INSERT OR REPLACE INTO migration_state VALUES (?, ?)");
+      while (cursor != migrations::kDone) {
+        transaction xct(db);
+        cursor = m.step(db, cursor);
+        if (cursor == migrations::kDone) {
+          command done(db, "DELETE FROM migration_state WHERE version = ?");
+          bindAndRun(&done, m.version);
+          if (db.executef("PRAGMA user_version = %d", m.version) != SQLITE_OK)
+            throw sqlite3pp::database_error(db);
+        } else {
+          bindAndRun(&save, db_row{m.version, cursor});
+        }
+        QMutexLocker locker(&db_lock);
+        xct.commit();
+        if (progress) {
+          double part = (size > 0 && cursor != migrations::kDone)
+                            ? std::min(1.0, cursor / static_cast<double>(size))
+                            : 1.0;
+          progress(static_cast<int>(100.0 * (i + part) / pending.size()));
+        }
+      }
     }
-    QMutexLocker locker(&db_lock);
-    xct.commit();
+    createViews();
+    return true;
   } catch (const exception& e) {
-    QLOG_DEBUG() << "cannot create database" << e.what();
+    QLOG_ERROR() << "Database::migrate - failed at version" << schemaVersion()
+                 << e.what();
+    return false;
   }
 }
 
+void Database::createViews() {
+  transaction xct(conn_->db());
+  migrations::createViews(conn_->db(), schemaVersion());
+  QMutexLocker locker(&db_lock);
+  xct.commit();
+}
+
 QMap<QString, QVariantList> Database::tableInfo(const QString& table) {
   // cid, name, type, notnull, dflt_value, pk
   QMap<QString, QVariantList> info;
@@ -245,6 +410,7 @@ void Database::disableSource(const QList<int>& sources) {
   }
   QMutexLocker locker(&db_lock);
   xct.commit();
+  textsChanged();
 }
 
 void Database::enableSource(const QList<int>& sources) {
@@ -257,6 +423,7 @@ void Database::enableSource(const QList<int>& sources) {
   }
   QMutexLocker locker(&db_lock);
   xct.commit();
+  textsChanged();
 }
 
 void Database::disableText(const QList<int>& texts) {
@@ -268,6 +435,7 @@ void Database::disableText(const QList<int>& texts) {
   }
   QMutexLocker locker(&db_lock);
   xct.commit();
+  textsChanged();
 }
 
 void Database::enableText(const QList<int>& texts) {
@@ -279,11 +447,14 @@ void Database::enableText(const QList<int>& texts) {
   }
   QMutexLocker locker(&db_lock);
   xct.commit();
+  textsChanged();
 }
 
 int Database::getSource(const QString& name, amphetype::text_type type) {
   try {
-    auto data = getOneRow("select id from source where name = ? limit 1", name);
+    auto data = getOneRow(
+        "select id from source where name = ? and disabled is null limit 1",
+        name);
     if (!data.empty()) return data[0].toInt();
     // source didn't exist. add it
     bindAndRun("insert into source values (NULL, ?, NULL, NULL, ?, 0)",
@@ -296,16 +467,85 @@ int Database::getSource(const QString& name, amphetype::text_type type) {
   }
 }
 
-void Database::deleteSource(const QList<int>& sources) {
+void Database::hideSources(const QList<int>& sources) {
   transaction xct(conn_->db());
   {
-    command cmd(conn_->db(), "DELETE FROM source WHERE id = ?");
-    for (int source : sources) {
-      bindAndRun(&cmd, source);
-    }
+    command cmd(conn_->db(), "UPDATE source SET disabled = 1 WHERE id = ?");
+    for (int source : sources) bindAndRun(&cmd, source);
   }
   QMutexLocker locker(&db_lock);
   xct.commit();
+  textsChanged();
+}
+
+QList<int> Database::hiddenSources() {
+  QList<int> sources;
+  for (const auto& row :
+       getRows("SELECT id FROM source WHERE disabled IS NOT NULL"))
+    sources << row[0].toInt();
+  return sources;
+}
+
+void Database::deleteSource(const QList<int>& sources,
+                            const std::function<void(int)>& progress) {
+  static const int kChunkSize = 500;
+  try {
+    hideSources(sources);
+    int total = 0;
+    for (int source : sources) total += getTextsCount(source);
+    int deleted = 0;
+
+    for (int source : sources) {
+      // texts and their results, a chunk at a time so other connections can
+      // write in between. The text count trigger is dropped for the chunk,
+      // so the count of the source is fixed once instead of for every text.
+      int changes;
+      do {
+        write_transaction xct(conn_->db());
+        {
+          command results(conn_->db(),
+                          "DELETE FROM result WHERE text_id IN "
+                          "(SELECT id FROM text WHERE source = ? LIMIT ?)");
+          bindAndRun(&results, db_row{source, kChunkSize});
+          if (conn_->db().execute("DROP TRIGGER text_count_subtract_trigger"))
+            throw sqlite3pp::database_error(conn_->db());
+          command texts(conn_->db(),
+                        "DELETE FROM text WHERE id IN "
+                        "(SELECT id FROM text WHERE source = ? LIMIT ?)");
+          execute(&texts, db_row{source, kChunkSize});
+          changes = conn_->db().changes();
+          command count(conn_->db(),
+                        "UPDATE source SET text_count = text_count - ? "
+                        "WHERE id = ?");
+          execute(&count, db_row{changes, source});
+          migrations::createTextCountTrigger(conn_->db());
+        }
+        QMutexLocker locker(&db_lock);
+        xct.commit();
+        deleted += changes;
+        if (progress && total) progress(100 * deleted / total);
+      } while (changes > 0);
+
+      write_transaction xct(conn_->db());
+      {
+        command results(conn_->db(), "DELETE FROM result WHERE source = ?");
+        bindAndRun(&results, source);
+        if (conn_->archived()) {
+          command archived(conn_->db(),
+                           "DELETE FROM archive.result WHERE source = ?");
+          bindAndRun(&archived, source);
+        }
+        command cmd(conn_->db(), "DELETE FROM source WHERE id = ?");
+        bindAndRun(&cmd, source);
+      }
+      QMutexLocker locker(&db_lock);
+      xct.commit();
+    }
+    resultsChanged();
+    textsChanged();
+  } catch (const exception& e) {
+    QLOG_ERROR() << "error deleting sources" << e.what();
+  }
 }
 
 void Database::deleteText(const QList<int>& text_ids) {
@@ -313,15 +553,36 @@ void Database::deleteText(const QList<int>& text_ids) {
   {
     command cmd(conn_->db(), "DELETE FROM text WHERE id = ?");
     for (int id : text_ids) bindAndRun(&cmd, id);
+    if (conn_->archived()) {
+      command archived(conn_->db(),
+                       "DELETE FROM archive.result WHERE text_id = ?");
+      for (int id : text_ids) bindAndRun(&archived, id);
+    }
   }
   QMutexLocker locker(&db_lock);
   xct.commit();
+  resultsChanged();
+  textsChanged();
 }
 
 void Database::deleteResult(const QString& id, const QString& datetime) {
-  bindAndRun(
-      "DELETE FROM result WHERE text_id is ? and datetime(w) = datetime(?)",
-      db_row{id, datetime});
+  transaction xct(conn_->db());
+  {
+    command cmd(conn_->db(),
+                "DELETE FROM result "
+                "WHERE text_id is ? and datetime(w) = datetime(?)");
+    bindAndRun(&cmd, db_row{id, datetime});
+    // archived keystroke logs go with their result, like the others.
+    if (conn_->archived()) {
+      command archived(conn_->db(),
+                       "DELETE FROM archive.result "
+                       "WHERE text_id is ? and datetime(w) = datetime(?)");
+      bindAndRun(&archived, db_row{id, datetime});
+    }
+  }
+  QMutexLocker locker(&db_lock);
+  xct.commit();
+  resultsChanged();
 }
 
 void Database::deleteResult(const QList<int>& ids) {
@@ -329,18 +590,50 @@ void Database::deleteResult(const QList<int>& ids) {
   {
     command cmd(conn_->db(), "DELETE FROM result WHERE id = ?");
     for (int id : ids) bindAndRun(&cmd, id);
+    if (conn_->archived()) {
+      command archived(conn_->db(), "DELETE FROM archive.result WHERE id = ?");
+      for (int id : ids) bindAndRun(&archived, id);
+    }
   }
   QMutexLocker locker(&db_lock);
   xct.commit();
+  resultsChanged();
 }
 
 void Database::deleteStatistic(const QString& data) {
-  bindAndRun("DELETE FROM statistic WHERE data = ?", data);
+  bindAndRun(
+      "DELETE FROM statistic WHERE ngram IN "
+      "(SELECT id FROM ngram WHERE text = ?)",
+      data);
+  bindAndRun(
+      "DELETE FROM statistic_rollup WHERE ngram IN "
+      "(SELECT id FROM ngram WHERE text = ?)",
+      data);
+  bindAndRun(
+      "DELETE FROM key_timing WHERE ngram IN "
+      "(SELECT id FROM ngram WHERE text = ?)",
+      data);
+  if (conn_->archived()) {
+    bindAndRun(
+        "DELETE FROM archive.statistic WHERE ngram IN "
+        "(SELECT id FROM main.ngram WHERE text = ?)",
+        data);
+    bindAndRun(
+        "DELETE FROM archive.key_timing WHERE ngram IN "
+        "(SELECT id FROM main.ngram WHERE text = ?)",
+        data);
+  }
+  bindAndRun(
+      "DELETE FROM review WHERE ngram IN "
+      "(SELECT id FROM ngram WHERE text = ?)",
+      data);
+  reviews_->invalidate();
 }
 
 void Database::addText(int source, const QString& text) {
   bindAndRun("INSERT INTO text VALUES (NULL, ?, ?, NULL)",
              db_row{source, text});
+  textsChanged();
 }
 
 void Database::addTexts(int source, const QStringList& texts) {
@@ -354,6 +647,7 @@ void Database::addTexts(int source, const QStringList& texts) {
     }
     QMutexLocker locker(&db_lock);
     xct.commit();
+    textsChanged();
   } catch (const exception& e) {
     QLOG_DEBUG() << "error adding text" << e.what();
   }
@@ -361,60 +655,245 @@ void Database::addTexts(int source, const QStringList& texts) {
 
 void Database::addResult(TestResult* result) {
   QLOG_DEBUG() << "saving result";
+  ngram_ids added;
   try {
-    transaction resultTransaction(conn_->db());
+    write_transaction resultTransaction(conn_->db());
+    insertResult(result, result->when.toString(Qt::ISODate), &added);
+    QMutexLocker locker(&db_lock);
+    commit(&resultTransaction, conn_->db());
+    ngrams_->insert(added);
+    resultAdded(result);
+  } catch (const exception& e) {
+    QLOG_ERROR() << "error adding result" << e.what();
+  }
+}
+
+void Database::insertResult(TestResult* result, const QVariant& w,
+                            ngram_ids* added) {
+  command cmd(conn_->db(),
+              "insert into result (w, text_id, source, wpm, accuracy, "
+              "viscosity) values (?, ?, ?, ?, ?, ?)");
+  execute(&cmd, db_row{w, result->text->id(), result->text->source(),
+                       result->wpm, result->accuracy, result->viscosity});
+  result->id = conn_->db().last_insert_rowid();
+  if (!result->key_timings.empty()) {
+    command timings(conn_->db(), kInsertKeyTiming);
+    insertKeyTimings(&timings, result, added);
+  }
+  if (result->keystrokes.isEmpty()) return;
+  command log(conn_->db(),
+              "INSERT INTO keystroke_log (result_id, data) VALUES (?, ?)");
+  execute(&log, db_row{result->id, result->keystrokes});
+}
+
+void Database::insertKeyTimings(command* cmd, TestResult* result,
+                                ngram_ids* added) {
+  for (const auto& timing : result->key_timings) {
+    const auto& t = timing.second;
+    execute(cmd, db_row{result->id,
+                        ngramId(timing.first, ngramType(timing.first), added),
+                        t.count, t.dwell, t.flight, t.overlaps});
+  }
+}
+
+void Database::saveResult(TestResult* result) {
+  QLOG_DEBUG() << "saving test";
+  int flags = result->text->saveFlags();
+  QString now = result->when.toString(Qt::ISODate);
+  ngram_ids added;
+  vector<ReviewSchedule::Entry> reviewed;
+  try {
+    write_transaction xct(conn_->db());
     {
-      command cmd(
-          conn_->db(),
-          "insert into result (w, text_id, source, wpm, accuracy, viscosity) "
-          "values (?, ?, ?, ?, ?, ?)");
-      bindAndRun(&cmd,
-                 db_row{result->when.toString(Qt::ISODate), result->text->id(),
-                        result->text->source(), result->wpm, result->accuracy,
-                        result->viscosity});
+      if (flags & amphetype::SaveFlags::SaveResults)
+        insertResult(result, now, &added);
+      if (flags & amphetype::SaveFlags::SaveStatistics) {
+        command cmd(conn_->db(), kInsertStatistic);
+        insertStatistics(&cmd, result, now, &added);
+        command reviews(conn_->db(), kInsertReview);
+        insertReviews(&reviews, result, &added, &reviewed);
+      }
+      if (flags & amphetype::SaveFlags::SaveMistakes) {
+        command cmd(conn_->db(), kInsertMistake);
+        insertMistakes(&cmd, result, now);
+      }
     }
     QMutexLocker locker(&db_lock);
-    resultTransaction.commit();
+    commit(&xct, conn_->db());
+    ngrams_->insert(added);
+    reviews_->update(reviewed);
+    if (flags & amphetype::SaveFlags::SaveResults) resultAdded(result);
   } catch (const exception& e) {
-    QLOG_DEBUG() << "error adding result" << e.what();
+    QLOG_ERROR() << "error saving test" << e.what();
   }
 }
 
 void Database::addStatistics(TestResult* result) {
   QLOG_DEBUG() << "saving statistics";
   QString now = result->when.toString(Qt::ISODate);
+  ngram_ids added;
+  vector<ReviewSchedule::Entry> reviewed;
   try {
-    transaction statisticsTransaction(conn_->db());
+    write_transaction statisticsTransaction(conn_->db());
     {
-      command cmd(conn_->db(),
-                  "INSERT INTO statistic (time, viscosity, w, count, mistakes, "
-                  "type, data) values (?, ?, ?, ?, ?, ?, ?)");
-      for (auto& item : result->stats_values) {
-        db_row items;
-        items.push_back(median(result->stats_values[item.first]));
-        items.push_back(median(result->viscosity_values[item.first]));
-        items.push_back(now);
-        items.push_back(
-            static_cast<int>(result->stats_values[item.first].size()));
-        items.push_back(result->mistake_counts[item.first]);
-
-        if (item.first.length() == 1)
-          items.push_back(static_cast<int>(amphetype::statistics::Type::Keys));
-        else if (item.first.length() == 3)
-          items.push_back(
-              static_cast<int>(amphetype::statistics::Type::Trigrams));
-        else
-          items.push_back(static_cast<int>(amphetype::statistics::Type::Words));
-
-        items.push_back(item.first);
-        bindAndRun(&cmd, items);
+      command cmd(conn_->db(), kInsertStatistic);
+      insertStatistics(&cmd, result, now, &added);
+      command reviews(conn_->db(), kInsertReview);
+      insertReviews(&reviews, result, &added, &reviewed);
+    }
+    QMutexLocker locker(&db_lock);
+    commit(&statisticsTransaction, conn_->db());
+    ngrams_->insert(added);
+    reviews_->update(reviewed);
+  } catch (const exception& e) {
+    QLOG_ERROR() << "error adding statistics" << e.what();
+  }
+}
+
+void Database::insertStatistics(command* cmd, TestResult* result,
+                                const QVariant& last, ngram_ids* added) {
+  auto& ngrams = result->ngrams;
+  // one row reused for every ngram, the samples are read exactly once.
+  db_row items(7);
+  items[5] = last;
+  if (result->id >= 0) items[6] = result->id;
+  for (int id = 0; id < ngrams.size(); ++id) {
+    int count = ngrams.count(id);
+    if (!count) continue;
+    auto ngram = ngrams.ngram(id).toString();
+    items[0] = median(ngrams.times(id), ngrams.times(id) + count);
+    items[1] = median(ngrams.viscosities(id), ngrams.viscosities(id) + count);
+    items[2] = count;
+    items[3] = ngrams.mistakes(id);
+    items[4] = ngramId(ngram, ngramType(ngram), added);
+    execute(cmd, items);
+  }
+}
+
+void Database::insertReviews(command* cmd, TestResult* result,
+                             ngram_ids* added,
+                             vector<ReviewSchedule::Entry>* reviewed) {
+  static const int kWords =
+      static_cast<int>(amphetype::statistics::Type::Words);
+  auto schedule = reviewSchedule();
+  auto& ngrams = result->ngrams;
+  qint64 now = result->when.toMSecsSinceEpoch() / 1000;
+  for (int id = 0; id < ngrams.size(); ++id) {
+    int count = ngrams.count(id);
+    auto ngram = ngrams.ngram(id).toString();
+    if (!count || ngramType(ngram) != kWords) continue;
+    double time = median(ngrams.times(id), ngrams.times(id) + count);
+    int quality = ReviewSchedule::quality(
+        ngrams.mistakes(id), time > 0 ? 12.0 / time : result->wpm,
+        result->wpm);
+    long long ngram_id = ngramId(ngram, kWords, added);
+    Review review;
+    bool scheduled = schedule->find(ngram_id, &review);
+    // words typed well only matter once they're scheduled, and passing a
+    // review before it's due doesn't stretch its interval.
+    if (!scheduled && quality > ReviewSchedule::kPass) continue;
+    if (scheduled && review.due > now && quality >= ReviewSchedule::kPass)
+      continue;
+    review = ReviewSchedule::grade(review, quality, now);
+    execute(cmd, db_row{ngram_id,
+                        QDateTime::fromMSecsSinceEpoch(review.due * 1000)
+                            .toString(Qt::ISODate),
+                        review.interval, review.ease, review.reps,
+                        review.lapses});
+    reviewed->push_back({ngram_id, ngram, review});
+  }
+}
+
+void Database::insertMistakes(command* cmd, TestResult* result,
+                              const QVariant& last) {
+  QVariant id = result->id >= 0 ? QVariant(result->id) : QVariant();
+  for (const auto& pair : result->mistakes) {
+    execute(cmd, db_row{pair.first.first, pair.first.second, pair.second,
+                        last, id});
+  }
+}
+
+void Database::replaceResults(const map<int, shared_ptr<TestResult>>& results) {
+  ngram_ids added;
+  int skipped = 0;
+  try {
+    write_transaction xct(conn_->db());
+    {
+      command deleteStatistics(conn_->db(),
+                               "DELETE FROM statistic WHERE result_id = ?");
+      command deleteMistakes(conn_->db(),
+                             "DELETE FROM mistake WHERE result_id = ?");
+      command deleteKeyTimings(conn_->db(),
+                               "DELETE FROM key_timing WHERE result_id = ?");
+      command update(conn_->db(),
+                     "UPDATE result SET wpm = ?, accuracy = ?, viscosity = ? "
+                     "WHERE id = ?");
+      command statistics(conn_->db(), kInsertStatistic);
+      command mistakes(conn_->db(), kInsertMistake);
+      command timings(conn_->db(), kInsertKeyTiming);
+      for (const auto& item : results) {
+        auto result = item.second.get();
+        int flags = result->text->saveFlags();
+        // the date of the result, its statistics and the rows at that date
+        // that aren't linked to a result.
+        auto row = getOneRow(
+            "SELECT w,"
+            " (SELECT count() FROM statistic WHERE result_id = result.id),"
+            " (SELECT count() FROM statistic "
+            "  WHERE w = result.w AND result_id IS NULL) + "
+            " (SELECT count() FROM mistake "
+            "  WHERE w = result.w AND result_id IS NULL) "
+            "FROM main.result WHERE id = ?",
+            item.first);
+        if (row.empty() || row[2].toInt() > 0 ||
+            ((flags & amphetype::SaveFlags::SaveStatistics) &&
+             !row[1].toInt())) {
+          ++skipped;
+          continue;
+        }
+        result->id = item.first;
+        bindAndRun(&update, db_row{result->wpm, result->accuracy,
+                                   result->viscosity, item.first});
+        bindAndRun(&deleteKeyTimings, item.first);
+        insertKeyTimings(&timings, result, &added);
+        // dated like the result they replace.
+        if (flags & amphetype::SaveFlags::SaveStatistics) {
+          bindAndRun(&deleteStatistics, item.first);
+          insertStatistics(&statistics, result, row[0], &added);
+        }
+        if (flags & amphetype::SaveFlags::SaveMistakes) {
+          bindAndRun(&deleteMistakes, item.first);
+          insertMistakes(&mistakes, result, row[0]);
+        }
       }
     }
     QMutexLocker locker(&db_lock);
-    statisticsTransaction.commit();
+    xct.commit();
+    ngrams_->insert(added);
+    resultsChanged();
   } catch (const exception& e) {
-    QLOG_DEBUG() << "error adding statistics" << e.what();
+    QLOG_ERROR() << "error replacing results" << e.what();
   }
+  if (skipped) QLOG_INFO() << "Database::replaceResults - skipped" << skipped;
+}
+
+long long Database::ngramId(const QString& ngram, int type,
+                            ngram_ids* added) {
+  auto key = qMakePair(type, ngram);
+  long long id = ngrams_->find(key);
+  if (id >= 0) return id;
+  if (added->contains(key)) return added->value(key);
+
+  command cmd(conn_->db(),
+              "INSERT OR IGNORE INTO ngram (text, type, length) "
+              "VALUES (?, ?, ?)");
+  execute(&cmd, db_row{ngram, type, ngram.length()});
+  auto row = getOneRow("SELECT id FROM ngram WHERE text = ? AND type = ?",
+                       db_row{ngram, type});
+  if (row.empty()) throw sqlite3pp::database_error("can't add ngram");
+  id = row[0].toLongLong();
+  added->insert(key, id);
+  return id;
 }
 
 void Database::addMistakes(TestResult* result) {
@@ -423,42 +902,109 @@ void Database::addMistakes(TestResult* result) {
   try {
     transaction mistakesTransaction(conn_->db());
     {
-      command cmd(conn_->db(),
-                  "INSERT INTO mistake (w, target, mistake, count) "
-                  "values (?, ?, ?, ?)");
-      for (const auto& pair : result->mistakes) {
-        bindAndRun(&cmd, db_row{now, pair.first.first, pair.first.second,
-                                pair.second});
-      }
+      command cmd(conn_->db(), kInsertMistake);
+      insertMistakes(&cmd, result, now);
     }
     QMutexLocker locker(&db_lock);
-    mistakesTransaction.commit();
+    commit(&mistakesTransaction, conn_->db());
   } catch (const exception& e) {
-    QLOG_DEBUG() << "error adding mistakes" << e.what();
+    QLOG_ERROR() << "error adding mistakes" << e.what();
   }
 }
 
-map<QDateTime, double> Database::resultsWpmRange() {
-  auto row = getOneRow(
-      "select * from (select w, wpm from result order by wpm desc limit 1) "
-      "left join (select w, wpm from result order by wpm asc limit 1)");
-  if (row.empty()) return map<QDateTime, double>();
-  return map<QDateTime, double>{
-      make_pair(QDateTime::fromString(row[0].toString(), Qt::ISODate),
-                row[1].toDouble()),
-      make_pair(QDateTime::fromString(row[2].toString(), Qt::ISODate),
-                row[3].toDouble())};
-}
-
 pair<double, double> Database::getMedianStats(int n) {
+  auto recent = recentResults();
+  const auto& sizes = recent->sizes();
+  if (std::binary_search(sizes.begin(), sizes.end(), n)) {
+    return make_pair(recent->median(RecentResults::Wpm, n),
+                     recent->median(RecentResults::Accuracy, n));
+  }
   auto cols = getOneRow(
-      "SELECT agg_median(wpm), 100.0 * agg_median(accuracy) "
-      "FROM result ORDER BY w DESC LIMIT ?",
+      QString("SELECT agg_median(wpm), 100.0 * agg_median(accuracy) FROM (%1)")
+          .arg(latestResults()),
       n);
   return cols.empty() ? pair<double, double>()
                       : make_pair(cols[0].toDouble(), cols[1].toDouble());
 }
 
+shared_ptr<RecentResults> Database::recentResults() {
+  if (recent_->loaded()) return recent_;
+  auto generation = recent_->beginLoad();
+  auto rows = getRows(
+      QString("SELECT wpm, 100.0 * accuracy, viscosity FROM (%1) "
+              "ORDER BY w DESC")
+          .arg(latestResults()),
+      recent_->capacity());
+  vector<std::array<double, 3>> results;
+  results.reserve(rows.size());
+  for (auto row = rows.rbegin(); row != rows.rend(); ++row) {
+    results.push_back({{(*row)[0].toDouble(), (*row)[1].toDouble(),
+                        (*row)[2].toDouble()}});
+  }
+  recent_->load(results, generation);
+  return recent_;
+}
+
+shared_ptr<ResultRanks> Database::resultRanks() {
+  if (ranks_->loaded()) return ranks_;
+  auto generation = ranks_->beginLoad();
+  auto rows = getRows(
+      QString("SELECT w, source, text_id, wpm, 100.0 * accuracy, viscosity "
+              "FROM %1")
+          .arg(resultTable()));
+  vector<ResultRanks::Entry> results;
+  results.reserve(rows.size());
+  for (const auto& row : rows) {
+    results.push_back(
+        {QDateTime::fromString(row[0].toString(), Qt::ISODate),
+         row[1].toInt(),
+         row[2].toInt(),
+         {{row[3].toDouble(), row[4].toDouble(), row[5].toDouble()}}});
+  }
+  ranks_->load(results, generation);
+  return ranks_;
+}
+
+void Database::resultAdded(TestResult* result) {
+  recent_->add(result->wpm, 100.0 * result->accuracy, result->viscosity);
+  ranks_->add({result->when,
+               result->text->source(),
+               result->text->id(),
+               {{result->wpm, 100.0 * result->accuracy, result->viscosity}}});
+}
+
+void Database::resultsChanged() {
+  recent_->invalidate();
+  ranks_->invalidate();
+}
+
+void Database::textsChanged() { index_->invalidate(); }
+
+shared_ptr<TextIndex> Database::textIndex() {
+  if (index_->loaded()) return index_;
+  TextIndex::Builder builder;
+  try {
+    // only reads, so the texts are tokenized without holding db_lock and
+    // commits on other connections go on meanwhile.
+    query qry(conn_->db(),
+              "SELECT text.id, text.text FROM text "
+              "LEFT JOIN source ON (text.source = source.id) "
+              "WHERE text.disabled IS NULL AND source.disabled IS NULL "
+              " AND source.type IS 0");
+    for (const auto& row : qry) {
+      builder.add(row.get<int>(0),
+                  QString::fromUtf8(row.get<char const*>(1)));
+    }
+  } catch (const exception& e) {
+    // a partial index would stay until the texts change, try again later.
+    QLOG_ERROR() << "error indexing texts" << e.what();
+    return index_;
+  }
+  index_->load(std::move(builder));
+  QLOG_DEBUG() << "indexed" << index_->size() << "texts";
+  return index_;
+}
+
 db_row Database::getSourceData(int source) {
   return getOneRow("SELECT * from sourceView WHERE id = ?", source);
 }
@@ -496,8 +1042,9 @@ db_rows Database::getPerformanceData(int w, int source, int limit, int g,
     case 0:
       break;
     case 1:
-      query << "text_id = (select text_id from result order by "
-               "datetime(w) desc limit 1)";
+      query << QString("text_id = (select text_id from %1 order by "
+                       "datetime(w) desc limit 1)")
+                   .arg(resultTable());
       break;
     case 2:
       query << "type = 0";
@@ -522,9 +1069,10 @@ db_rows Database::getPerformanceData(int w, int source, int limit, int g,
             "strftime('%Y-%m-%dT%H:%M:%S', avg(julianday(date))),"
             "count(*) || ' result(s)',"
             "agg_median(wpm), agg_median(accuracy), agg_median(viscosity),"
-            "(select count(*) from result) - ((select count(*) from result "
+            "(select count(*) from %2) - ((select count(*) from %2 "
             "as r2 where r2.id <= performanceView.id) - 1) / %1 as grouping")
-            .arg(n);
+            .arg(n)
+            .arg(resultTable());
     group_by = (g == 1) ? "GROUP BY cast(strftime('%s', date) / 86400 as int)"
                         : "GROUP BY grouping";
   }
@@ -582,9 +1130,9 @@ db_rows Database::getStatisticsData(const QString& when,
       " sum(mistakes) as mistakes,"
       " sum(count) * pow(agg_median(time), 2) "
       "   * (1.0 + sum(mistakes) / sum(count)) as damage "
-      "FROM statistic "
+      "FROM statisticView "
       "WHERE w >= datetime(?) AND type = ? "
-      "GROUP by data "
+      "GROUP by ngram "
       "HAVING total >= ? "
       "ORDER BY %1 LIMIT ?";
 
@@ -592,6 +1140,71 @@ db_rows Database::getStatisticsData(const QString& when,
                  db_row{when, static_cast<int>(type), count, limit});
 }
 
+ngram_statistics Database::textStatistics(const Text& text, int days) {
+  QString since =
+      QDateTime::currentDateTime().addDays(-days).toString(Qt::ISODate);
+  ngram_statistics statistics;
+  try {
+    // the ids of the ngrams of the text go in a temporary table, so their
+    // statistics are aggregated in one pass over the ngram index.
+    transaction xct(conn_->db());
+    {
+      auto& db = conn_->db();
+      if (db.execute("CREATE TEMP TABLE IF NOT EXISTS text_ngram("
+                     "id INTEGER PRIMARY KEY)") != SQLITE_OK ||
+          db.execute("DELETE FROM temp.text_ngram") != SQLITE_OK)
+        throw sqlite3pp::database_error(db);
+      command cmd(db,
+                  "INSERT OR IGNORE INTO temp.text_ngram "
+                  "SELECT id FROM ngram WHERE text = ? AND type = ?");
+      const auto& ngrams = text.analysis(false)->ngrams();
+      db_row items(2);
+      for (int id = 0; id < ngrams.size(); ++id) {
+        auto ngram = ngrams.ngram(id).toString();
+        items[0] = ngram;
+        items[1] = ngramType(ngram);
+        bindAndRun(&cmd, items);
+      }
+    }
+    QMutexLocker locker(&db_lock);
+    xct.commit();
+  } catch (const exception& e) {
+    QLOG_ERROR() << "error looking up text ngrams:" << e.what();
+    return statistics;
+  }
+
+  auto rows = getRows(
+      "SELECT ngram.text, ngram.type,"
+      " 12.0 / agg_median(time),"
+      " 100 * max(0, (1.0 - sum(mistakes) / "
+      "   (sum(count) * cast(length(ngram.text) as real)))),"
+      " agg_median(viscosity),"
+      " sum(count),"
+      " sum(mistakes),"
+      " sum(count) * pow(agg_median(time), 2) "
+      "   * (1.0 + sum(mistakes) / sum(count)) "
+      "FROM ("
+      " SELECT ngram, time, count, mistakes, viscosity FROM statistic"
+      " WHERE ngram IN (SELECT id FROM temp.text_ngram)"
+      "  AND w >= datetime(?1)"
+      " UNION ALL"
+      " SELECT ngram, time, count, mistakes, viscosity FROM statistic_rollup"
+      " WHERE ngram IN (SELECT id FROM temp.text_ngram)"
+      "  AND w >= datetime(?1)) s "
+      "JOIN ngram ON (ngram.id = s.ngram) "
+      "GROUP BY s.ngram",
+      since);
+  statistics.reserve(static_cast<int>(rows.size()));
+  for (const auto& row : rows) {
+    statistics.insert(
+        qMakePair(row[1].toInt(), row[0].toString()),
+        NgramStatistics{row[2].toDouble(), row[3].toDouble(),
+                        row[4].toDouble(), row[5].toInt(), row[6].toInt(),
+                        row[7].toDouble()});
+  }
+  return statistics;
+}
+
 db_rows Database::getSourcesList() {
   return getRows("SELECT id, name FROM source ORDER BY name");
 }
@@ -610,12 +1223,14 @@ shared_ptr<Text> Database::getRandomText() {
       "SELECT text.id, source, text, name, type "
       "FROM text "
       "LEFT JOIN source ON (text.source = source.id) "
-      "WHERE text.disabled IS NULL and source.type is 0 "
+      "WHERE text.disabled IS NULL and source.disabled IS NULL "
+      " and source.type is 0 "
       "LIMIT 1 "
       "OFFSET abs(random()) % max("
       " (SELECT COUNT(*) FROM text LEFT JOIN source "
       "  ON (text.source = source.id) where "
-      "  text.disabled is NULL and source.type is 0), 1)");
+      "  text.disabled is NULL and source.disabled is NULL "
+      "  and source.type is 0), 1)");
 }
 
 shared_ptr<Text> Database::getNextText() {
@@ -640,6 +1255,7 @@ shared_ptr<Text> Database::getNextText(int text_id) {
       "FROM text "
       "LEFT JOIN source ON (text.source = source.id) "
       "WHERE text.id > ? AND text.disabled IS NULL "
+      " AND source.disabled IS NULL "
       "ORDER BY text.id ASC "
       "LIMIT 1",
       text_id);
@@ -658,8 +1274,348 @@ shared_ptr<Text> Database::textFromStats(amphetype::statistics::Order type,
                                     Generators::generateText(words, length));
 }
 
+shared_ptr<Text> Database::textFromReviews(int count, int length) {
+  QStringList words = reviewSchedule()->next(
+      count, QDateTime::currentMSecsSinceEpoch() / 1000);
+  if (words.isEmpty()) {
+    // nothing is due, practice the words that need it the most.
+    auto rows = getStatisticsData(
+        QDateTime::currentDateTime().addDays(-30).toString(Qt::ISODate),
+        amphetype::statistics::Type::Words, 0,
+        amphetype::statistics::Order::Damaging, count);
+    for (const auto& row : rows) words.append(row[0].toString());
+  }
+  if (words.isEmpty()) return make_shared<Text>();
+  return make_shared<ReviewDrill>(Generators::generateText(words, length));
+}
+
+shared_ptr<ReviewSchedule> Database::reviewSchedule() {
+  if (reviews_->loaded()) return reviews_;
+  auto rows = getRows(
+      "SELECT review.ngram, ngram.text, due, interval, ease, reps, lapses "
+      "FROM review JOIN ngram ON (review.ngram = ngram.id)");
+  vector<ReviewSchedule::Entry> entries;
+  entries.reserve(rows.size());
+  for (const auto& row : rows) {
+    Review review;
+    review.due = QDateTime::fromString(row[2].toString(), Qt::ISODate)
+                     .toMSecsSinceEpoch() /
+                 1000;
+    review.interval = row[3].toDouble();
+    review.ease = row[4].toDouble();
+    review.reps = row[5].toInt();
+    review.lapses = row[6].toInt();
+    entries.push_back({row[0].toLongLong(), row[1].toString(), review});
+  }
+  reviews_->load(entries);
+  return reviews_;
+}
+
+shared_ptr<Text> Database::textForWeakSpots(const Text* last, int days) {
+  // the texts scored best are close, pick from a few so they're not repeated.
+  static const int kCandidates = 10;
+  static const int kWeakSpots = 50;
+  QString since =
+      QDateTime::currentDateTime().addDays(-days).toString(Qt::ISODate);
+  QHash<QString, float> weights;
+  for (auto type : {amphetype::statistics::Type::Trigrams,
+                    amphetype::statistics::Type::Words}) {
+    auto rows = getStatisticsData(since, type, 3,
+                                  amphetype::statistics::Order::Damaging,
+                                  kWeakSpots);
+    if (rows.empty()) continue;
+    // relative to the most damaging of its type, so both count alike.
+    double most = rows[0][6].toDouble();
+    if (most <= 0) continue;
+    for (const auto& row : rows)
+      weights[row[0].toString()] += row[6].toDouble() / most;
+  }
+  if (weights.isEmpty()) return getRandomText();
+
+  auto matches = textIndex()->search(weights, kCandidates + 1);
+  if (last) {
+    matches.erase(std::remove_if(matches.begin(), matches.end(),
+                                 [last](const TextIndex::Match& m) {
+                                   return m.text == last->id();
+                                 }),
+                  matches.end());
+  }
+  if (matches.empty()) return getRandomText();
+  std::random_device rd;
+  std::mt19937 g(rd());
+  std::uniform_int_distribution<int> pick(
+      0, std::min<int>(kCandidates, matches.size()) - 1);
+  return getText(matches[pick(g)].text);
+}
+
 void Database::updateText(int id, const QString& newText) {
   bindAndRun("UPDATE text SET text = ? WHERE id = ?", db_row{newText, id});
+  textsChanged();
+}
+
+void Database::archive(int days) {
+  QString cutoff =
+      QDateTime::currentDateTime().addDays(-days).toString(Qt::ISODate);
+  QLOG_DEBUG() << "Database::archive - archiving data older than" << cutoff;
+  try {
+    auto archive = archivePath();
+    conn_->attachArchive(archive.isEmpty() ? ":memory:" : archive);
+
+    write_transaction xct(conn_->db());
+    {
+      const char* statements[] = {
+          "INSERT INTO archive.result "
+          "SELECT id, w, text_id, source, wpm, accuracy, viscosity "
+          "FROM main.result WHERE w < ?",
+          "INSERT INTO archive.keystroke_log "
+          "SELECT result_id, data FROM main.keystroke_log WHERE result_id IN "
+          "(SELECT id FROM main.result WHERE w < ?)",
+          "INSERT INTO archive.key_timing "
+          "SELECT result_id, ngram, count, dwell, flight, overlaps "
+          "FROM main.key_timing WHERE result_id IN "
+          "(SELECT id FROM main.result WHERE w < ?)",
+          "DELETE FROM main.result WHERE w < ?",
+
+          "INSERT INTO archive.statistic "
+          "SELECT w, ngram, time, count, mistakes, viscosity "
+          "FROM main.statistic WHERE w < ?",
+          "INSERT INTO statistic_rollup "
+          "SELECT strftime('%Y-%m-%dT%H:%M:%S', avg(julianday(w))), ngram,"
+          " sum(time * count) / sum(count), sum(count), sum(mistakes),"
+          " agg_median(viscosity) "
+          "FROM main.statistic WHERE w < ? "
+          "GROUP BY ngram, cast(strftime('%s', w) / 86400 as int)",
+          "DELETE FROM main.statistic WHERE w < ?",
+
+          "INSERT INTO archive.mistake "
+          "SELECT w, target, mistake, count FROM main.mistake WHERE w < ?",
+          "INSERT INTO mistake_rollup "
+          "SELECT strftime('%Y-%m-%dT%H:%M:%S', avg(julianday(w))),"
+          " target, mistake, sum(count) "
+          "FROM main.mistake WHERE w < ? "
+          "GROUP BY target, mistake, cast(strftime('%s', w) / 86400 as int)",
+          "DELETE FROM main.mistake WHERE w < ?"};
+      // a statement that fails has to undo the others, or rows would be
+      // deleted without having been copied.
+      for (const char* sql : statements) {
+        command cmd(conn_->db(), sql);
+        execute(&cmd, db_row{cutoff});
+      }
+    }
+    QMutexLocker locker(&db_lock);
+    xct.commit();
+    resultsChanged();
+  } catch (const exception& e) {
+    QLOG_ERROR() << "error archiving data" << e.what();
+  }
+}
+
+bool Database::mergeProfile(const QString& path) {
+  QLOG_INFO() << "Database::mergeProfile -" << path;
+  if (!QFileInfo::exists(path) || QFileInfo(path) == QFileInfo(path_)) {
+    QLOG_ERROR() << "can't merge profile" << path;
+    return false;
+  }
+  {
+    // both profiles need the same schema.
+    Database other(path);
+    if (!other.migrate()) return false;
+  }
+
+  auto& db = conn_->db();
+  if (db.attach(path.toUtf8().constData(), "other") != SQLITE_OK) {
+    QLOG_ERROR() << "can't attach profile" << path << db.error_msg();
+    return false;
+  }
+  auto other_archive = archive_path(path);
+  bool other_archived =
+      QFileInfo::exists(other_archive) &&
+      db.attach(other_archive.toUtf8().constData(), "other_archive") ==
+          SQLITE_OK;
+
+  // rows already in this profile, archived or not, are not merged again.
+  QString results = resultTable();
+  QString statistics =
+      conn_->archived() ? "(SELECT w, ngram FROM main.statistic UNION ALL "
+                          " SELECT w, ngram FROM archive.statistic)"
+                        : "main.statistic";
+  QString mistakes =
+      conn_->archived()
+          ? "(SELECT w, target, mistake FROM main.mistake UNION ALL "
+            " SELECT w, target, mistake FROM archive.mistake)"
+          : "main.mistake";
+  QString other_results =
+      other_archived ? "(SELECT * FROM other.result UNION ALL "
+                       " SELECT * FROM other_archive.result)"
+                     : "other.result";
+
+  QStringList statements;
+  // sources are matched by name, the map goes from the other profile's ids
+  // to the ones in this profile.
+  statements
+      << "INSERT INTO main.source (name, disabled, discount, type, text_count) "
+         "SELECT name, NULL, discount, type, 0 FROM other.source o "
+         "WHERE o.disabled IS NULL AND NOT EXISTS ("
+         " SELECT 1 FROM main.source s WHERE s.name = o.name "
+         " AND s.type IS o.type AND s.disabled IS NULL) "
+         "GROUP BY name, type ORDER BY min(o.id)"
+      << "CREATE TEMP TABLE merge_source("
+         "other_id INTEGER PRIMARY KEY, id INTEGER)"
+      << "INSERT INTO merge_source "
+         "SELECT o.id, (SELECT s.id FROM main.source s WHERE s.name = o.name "
+         " AND s.type IS o.type AND s.disabled IS NULL ORDER BY s.id LIMIT 1) "
+         "FROM other.source o WHERE o.disabled IS NULL";
+  // texts are matched by content within their source, using a hash.
+  QString match_texts =
+      "UPDATE merge_text SET id = ("
+      " SELECT t.id FROM main_text h JOIN main.text t ON (t.id = h.id) "
+      " WHERE h.source = merge_text.source AND h.hash = merge_text.hash "
+      " AND t.text = (SELECT text FROM other.text "
+      "               WHERE id = merge_text.other_id) "
+      " ORDER BY t.id LIMIT 1) "
+      "WHERE id IS NULL";
+  statements
+      << "CREATE TEMP TABLE merge_text(other_id INTEGER PRIMARY KEY, "
+         "source INTEGER, hash INTEGER, id INTEGER)"
+      << "INSERT INTO merge_text "
+         "SELECT o.id, ms.id, text_hash(o.text), NULL FROM other.text o "
+         "JOIN merge_source ms ON (ms.other_id = o.source)"
+      << "CREATE TEMP TABLE main_text AS "
+         "SELECT id, source, text_hash(text) as hash FROM main.text "
+         "WHERE source IN (SELECT id FROM merge_source)"
+      << "CREATE INDEX temp.main_text_idx ON main_text(source, hash)"
+      << match_texts
+      << "CREATE TEMP TABLE merge_state AS "
+         "SELECT coalesce(max(id), 0) as last_text,"
+         " (SELECT coalesce(max(id), 0) FROM main.result) as last_result "
+         "FROM main.text"
+      << "INSERT INTO main.text (source, text, disabled) "
+         "SELECT m.source, o.text, o.disabled FROM merge_text m "
+         "JOIN other.text o ON (o.id = m.other_id) WHERE m.id IS NULL "
+         "GROUP BY m.source, m.hash, o.text ORDER BY min(m.other_id)"
+      << "INSERT INTO main_text "
+         "SELECT id, source, text_hash(text) FROM main.text "
+         "WHERE id > (SELECT last_text FROM merge_state)"
+      << match_texts;
+  // results, with their text and source ids remapped.
+  statements << QString(
+                    "INSERT INTO main.result "
+                    "(w, text_id, source, wpm, accuracy, viscosity) "
+                    "SELECT o.w, mt.id, ms.id, o.wpm, o.accuracy, o.viscosity "
+                    "FROM %1 as o "
+                    "LEFT JOIN merge_text mt ON (mt.other_id = o.text_id) "
+                    "LEFT JOIN merge_source ms ON (ms.other_id = o.source) "
+                    "WHERE (o.source IS NULL OR ms.id IS NOT NULL) "
+                    "AND NOT EXISTS (SELECT 1 FROM %2 as r "
+                    " WHERE r.w = o.w AND r.wpm = o.wpm) "
+                    "ORDER BY o.w")
+                    .arg(other_results, results);
+  // the new results are found again by date and wpm, like above, so that
+  // their keystroke logs, statistics and mistakes can follow them.
+  QString other_logs =
+      other_archived ? "(SELECT * FROM other.keystroke_log UNION ALL "
+                       " SELECT * FROM other_archive.keystroke_log)"
+                     : "other.keystroke_log";
+  statements
+      << "CREATE TEMP TABLE merge_result("
+         "other_id INTEGER PRIMARY KEY, id INTEGER)"
+      << QString("INSERT OR IGNORE INTO merge_result "
+                 "SELECT o.id, r.id FROM %1 as o "
+                 "JOIN main.result r ON (r.w = o.w AND r.wpm = o.wpm) "
+                 "WHERE r.id > (SELECT last_result FROM merge_state)")
+             .arg(other_results)
+      << QString("INSERT OR IGNORE INTO main.keystroke_log (result_id, data) "
+                 "SELECT mr.id, o.data FROM %1 as o "
+                 "JOIN merge_result mr ON (mr.other_id = o.result_id)")
+             .arg(other_logs);
+  // statistics, with their ngram ids remapped.
+  statements
+      << "INSERT OR IGNORE INTO main.ngram (text, type, length) "
+         "SELECT text, type, length FROM other.ngram"
+      << "CREATE TEMP TABLE merge_ngram("
+         "other_id INTEGER PRIMARY KEY, id INTEGER)"
+      << "INSERT INTO merge_ngram SELECT o.id, n.id FROM other.ngram o "
+         "JOIN main.ngram n ON (n.text = o.text AND n.type = o.type)"
+      << QString("INSERT OR IGNORE INTO main.key_timing "
+                 "(result_id, ngram, count, dwell, flight, overlaps) "
+                 "SELECT mr.id, mn.id, o.count, o.dwell, o.flight, "
+                 " o.overlaps FROM %1 as o "
+                 "JOIN merge_result mr ON (mr.other_id = o.result_id) "
+                 "JOIN merge_ngram mn ON (mn.other_id = o.ngram)")
+             .arg(other_archived
+                      ? "(SELECT * FROM other.key_timing UNION ALL "
+                        " SELECT * FROM other_archive.key_timing)"
+                      : "other.key_timing");
+  // rollups have no result to link to.
+  QString result_id = ", result_id";
+  QString merged_result =
+      ", (SELECT id FROM merge_result WHERE other_id = o.result_id)";
+  for (const auto& table : {"statistic", "statistic_rollup"}) {
+    bool rollup = table != QString("statistic");
+    statements << QString(
+                      "INSERT INTO main.%1 "
+                      "(w, ngram, time, count, mistakes, viscosity%3) "
+                      "SELECT o.w, mn.id, o.time, o.count, o.mistakes, "
+                      " o.viscosity%4 "
+                      "FROM other.%1 o "
+                      "JOIN merge_ngram mn ON (mn.other_id = o.ngram) "
+                      "WHERE NOT EXISTS (SELECT 1 FROM %2 as s "
+                      " WHERE s.w = o.w AND s.ngram = mn.id)")
+                      .arg(table)
+                      .arg(rollup ? QString("main.statistic_rollup")
+                                  : statistics)
+                      .arg(rollup ? QString() : result_id)
+                      .arg(rollup ? QString() : merged_result);
+  }
+  for (const auto& table : {"mistake", "mistake_rollup"}) {
+    bool rollup = table != QString("mistake");
+    statements << QString(
+                      "INSERT INTO main.%1 (w, target, mistake, count%3) "
+                      "SELECT o.w, o.target, o.mistake, o.count%4 "
+                      "FROM other.%1 o "
+                      "WHERE NOT EXISTS (SELECT 1 FROM %2 as m "
+                      " WHERE m.w = o.w AND m.target = o.target "
+                      " AND m.mistake = o.mistake)")
+                      .arg(table)
+                      .arg(rollup ? QString("main.mistake_rollup") : mistakes)
+                      .arg(rollup ? QString() : result_id)
+                      .arg(rollup ? QString() : merged_result);
+  }
+  // reviews of words that are already scheduled here are kept.
+  statements << "INSERT OR IGNORE INTO main.review "
+                "(ngram, due, interval, ease, reps, lapses) "
+                "SELECT mn.id, o.due, o.interval, o.ease, o.reps, o.lapses "
+                "FROM other.review o "
+                "JOIN merge_ngram mn ON (mn.other_id = o.ngram)";
+  statements << "DROP TABLE temp.merge_source"
+             << "DROP TABLE temp.merge_text"
+             << "DROP TABLE temp.main_text"
+             << "DROP TABLE temp.merge_state"
+             << "DROP TABLE temp.merge_result"
+             << "DROP TABLE temp.merge_ngram";
+
+  bool ok = true;
+  try {
+    write_transaction xct(db);
+    {
+      for (const auto& sql : statements) {
+        if (db.execute(sql.toUtf8().constData()) != SQLITE_OK)
+          throw sqlite3pp::database_error(db);
+      }
+    }
+    QMutexLocker locker(&db_lock);
+    xct.commit();
+    resultsChanged();
+    textsChanged();
+    reviews_->invalidate();
+  } catch (const exception& e) {
+    QLOG_ERROR() << "error merging profile" << path << e.what();
+    ok = false;
+  }
+
+  if (other_archived) db.detach("other_archive");
+  db.detach("other");
+  return ok;
 }
 
 void Database::compress() {
@@ -678,16 +1634,18 @@ void Database::compress() {
 
   QString sql =
       "SELECT strftime('%Y-%m-%dT%H:%M:%S', avg(julianday(w))),"
-      " data, type, sum(time * count) / sum(count), sum(count), sum(mistakes),"
+      " ngram, sum(time * count) / sum(count), sum(count), sum(mistakes),"
       " agg_median(viscosity) "
       "FROM statistic "
       "WHERE datetime(w) <= datetime('%1') "
-      "GROUP BY data, type, cast(strftime('%s', w) / %2 as int)";
+      "GROUP BY ngram, cast(strftime('%s', w) / %2 as int)";
 
   command del(conn_->db(),
               "DELETE FROM statistic WHERE datetime(w) <= datetime(?)");
   command insert(conn_->db(),
-                 "INSERT INTO statistic VALUES (?, ?, ?, ?, ?, ?, ?)");
+                 "INSERT INTO statistic "
+                 "(w, ngram, time, count, mistakes, viscosity) "
+                 "VALUES (?, ?, ?, ?, ?, ?)");
 
   int compressed_groups = 0;
   for (const auto& g : groupings) {
@@ -697,7 +1655,7 @@ void Database::compress() {
     auto rows = getRows(sql.arg(g.first).arg(g.second));
     if (rows.empty()) continue;
 
-    transaction xct(conn_->db());
+    write_transaction xct(conn_->db());
     {
       bindAndRun(&del, g.first);
       for (const auto& row : rows) bindAndRun(&insert, row);
@@ -728,8 +1686,8 @@ map<QChar, map<QString, QVariant>> Database::getKeyFrequency() {
       "agg_median(viscosity) as viscosity,"
       "sum(count) * pow(agg_median(time), 2)"
       "* (1.0 + sum(mistakes) / sum(count)) as damage "
-      "from statistic "
-      "where type is 0 group by data");
+      "from statisticView "
+      "where type is 0 group by ngram");
 
   map<QChar, map<QString, QVariant>> data;
   for (const auto& row : rows) {
@@ -744,6 +1702,43 @@ map<QChar, map<QString, QVariant>> Database::getKeyFrequency() {
   return data;
 }
 
+QByteArray Database::getKeystrokeLog(int result_id) {
+  QString sql = "SELECT data FROM main.keystroke_log WHERE result_id = ?";
+  db_row args{result_id};
+  if (conn_->archived()) {
+    sql += " UNION ALL "
+           "SELECT data FROM archive.keystroke_log WHERE result_id = ?";
+    args.push_back(result_id);
+  }
+  auto row = getOneRow(sql, args);
+  return row.empty() ? QByteArray() : row[0].toByteArray();
+}
+
+map<QString, KeyTiming> Database::getKeyTimings(int result_id) {
+  QString sql =
+      "SELECT ngram.text, count, dwell, flight, overlaps "
+      "FROM main.key_timing JOIN main.ngram ON (ngram.id = key_timing.ngram) "
+      "WHERE result_id = ?";
+  db_row args{result_id};
+  if (conn_->archived()) {
+    sql += " UNION ALL "
+           "SELECT ngram.text, count, dwell, flight, overlaps "
+           "FROM archive.key_timing "
+           "JOIN main.ngram ON (ngram.id = key_timing.ngram) "
+           "WHERE result_id = ?";
+    args.push_back(result_id);
+  }
+  map<QString, KeyTiming> timings;
+  for (const auto& row : getRows(sql, args)) {
+    auto& timing = timings[row[0].toString()];
+    timing.count = row[1].toInt();
+    timing.dwell = row[2].toDouble();
+    timing.flight = row[3].toDouble();
+    timing.overlaps = row[4].toInt();
+  }
+  return timings;
+}
+
 db_row Database::getOneRow(const QString& sql, const db_row& args) const {
   auto rows = getRows(sql, args);
   return rows.empty() ? db_row() : rows[0];
@@ -764,6 +1759,9 @@ void Database::bind(statement* statement, const db_row& values,
       statement->bind(pos, strings.back(), sqlite3pp::nocopy);
     } else if (value.type() == QMetaType::QChar) {
       statement->bind(pos, value.toString().toStdString(), sqlite3pp::copy);
+    } else if (value.type() == QMetaType::QByteArray) {
+      auto bytes = value.toByteArray();
+      statement->bind(pos, bytes.constData(), bytes.size(), sqlite3pp::copy);
     } else {
       statement->bind(pos, value.toDouble());
     }
@@ -780,8 +1778,15 @@ db_rows Database::getRows(const QString& sql, const db_row& args) const {
     db_rows data;
     for (const auto& row_data : query) {
       db_row row;
-      for (int column = 0; column < query.column_count(); ++column)
-        row.push_back(row_data.get<char const*>(column));
+      for (int column = 0; column < query.column_count(); ++column) {
+        if (row_data.column_type(column) == SQLITE_BLOB) {
+          row.push_back(QByteArray(
+              static_cast<const char*>(row_data.get<void const*>(column)),
+              row_data.column_bytes(column)));
+        } else {
+          row.push_back(row_data.get<char const*>(column));
+        }
+      }
       data.push_back(row);
     }
     return data;
@@ -816,6 +1821,14 @@ void Database::bindAndRun(command* cmd, const QVariant& value) {
   bindAndRun(cmd, db_row{value});
 }
 
+void Database::execute(command* cmd, const db_row& values) {
+  vector<string> strings;
+  bind(cmd, values, strings);
+  if (cmd->execute() != SQLITE_OK)
+    throw sqlite3pp::database_error(conn_->db());
+  cmd->reset();
+}
+
 void Database::bindAndRun(command* cmd, const db_row& values) {
   try {
     vector<string> strings;
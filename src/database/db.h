@@ -19,14 +19,18 @@
 #ifndef SRC_DATABASE_DB_H_
 #define SRC_DATABASE_DB_H_
 
+#include <QByteArray>
 #include <QChar>
+#include <QHash>
 #include <QList>
 #include <QObject>
+#include <QPair>
 #include <QString>
 #include <QVariant>
 #include <QVariantList>
 
 #include <array>
+#include <functional>
 #include <map>
 #include <memory>
 #include <utility>
@@ -35,8 +39,12 @@
 #include <sqlite3pp.h>
 #include <sqlite3ppext.h>
 
+#include "database/recentresults.h"
+#include "database/resultranks.h"
+#include "database/reviewschedule.h"
 #include "quizzer/testresult.h"
 #include "texts/text.h"
+#include "texts/textindex.h"
 
 using std::vector;
 using std::shared_ptr;
@@ -50,14 +58,35 @@ using sqlite3pp::database;
 
 typedef vector<QVariant> db_row;
 typedef vector<vector<QVariant>> db_rows;
+//! (type, ngram) -> id in the ngram table.
+typedef QHash<QPair<int, QString>, long long> ngram_ids;
+
+//! the statistics of an ngram aggregated like a row of getStatisticsData.
+struct NgramStatistics {
+  double wpm;
+  double accuracy;
+  double viscosity;
+  int count;
+  int mistakes;
+  double damage;
+};
+//! (type, ngram) -> its statistics.
+typedef QHash<QPair<int, QString>, NgramStatistics> ngram_statistics;
+
+class NgramDictionary;
 
 class DBConnection {
  public:
-  explicit DBConnection(const QString&);
+  //! \param archive an archive database to attach, if it exists.
+  explicit DBConnection(const QString&, const QString& archive = QString());
   database& db();
+  //! attach an archive database, creating it if necessary.
+  void attachArchive(const QString& path);
+  bool archived() const;
 
  private:
   database db_;
+  bool archived_ = false;
   sqlite3pp::ext::function func_;
   sqlite3pp::ext::aggregate aggr_;
 };
@@ -67,8 +96,21 @@ class Database : public QObject {
 
  public:
   explicit Database(const QString& name = QString());
-  //! creates the database schema if necessary.
-  void initDB();
+  /*! creates the database schema if necessary and applies any quick
+    migrations. Returns false if long running migrations are still pending,
+    those should be applied in the background with a Migrator. */
+  bool initDB();
+  /*! apply pending migrations, in chunks, reporting progress in percent.
+    \param background also run the long running migrations.
+    \return true if the database is at the latest schema version. */
+  bool migrate(bool background = true,
+               const std::function<void(int)>& progress = {});
+  //! the schema version of the database, from PRAGMA user_version.
+  int schemaVersion() const;
+  /*! While set, databases opened afterwards are read only. Used while a
+    profile is being migrated in the background. */
+  static void setReadOnly(bool);
+  static bool readOnly();
 
   //! add a text to a source id.
   void addText(int source, const QString&);
@@ -80,9 +122,27 @@ class Database : public QObject {
   void addStatistics(TestResult*);
   //! save the mistakes of a test to the db.
   void addMistakes(TestResult*);
+  /*! save whatever the text of a test allows of its result, statistics and
+    mistakes to the db in a single transaction. */
+  void saveResult(TestResult*);
+  /*! replace the numbers, statistics and mistakes of existing results,
+    keyed by result id, with the given ones in a single transaction. Only
+    what the text of a result saves is replaced. Results whose rows can't be
+    told apart, because they were archived, compressed or saved at the same
+    time as another result, are skipped. */
+  void replaceResults(const map<int, shared_ptr<TestResult>>& results);
 
-  //! Delete the sources with the given ids
-  void deleteSource(const QList<int>& sources);
+  /*! hide the sources from the library and text selection until they're
+    deleted. A hidden source is marked in source.disabled, a source shows as
+    disabled in the library when all its texts are. */
+  void hideSources(const QList<int>& sources);
+  //! sources that were hidden but not yet deleted.
+  QList<int> hiddenSources();
+  /*! Delete the sources with the given ids. They are hidden first and their
+    texts and results are deleted in short transactions. `progress` gets the
+    percentage of deleted texts. */
+  void deleteSource(const QList<int>& sources,
+                    const std::function<void(int)>& progress = {});
   //! Delete the texts with the given ids
   void deleteText(const QList<int>& text_ids);
   //! Delete the result for the given text id at the given time.
@@ -106,19 +166,31 @@ class Database : public QObject {
 
   QMap<QString, QVariantList> tableInfo(const QString& table);
 
-  //! Get the best and worst WPM results and their times.
-  map<QDateTime, double> resultsWpmRange();
-  pair<double, double> getMedianStats(int);
+  //! the median wpm and accuracy in percent of the last n results.
+  pair<double, double> getMedianStats(int n);
+  /*! the rolling statistics of the recent results of the profile, loaded
+    when they're first needed. */
+  shared_ptr<RecentResults> recentResults();
+  /*! the ranks of every result of the profile, including archived ones,
+    loaded when they're first needed. */
+  shared_ptr<ResultRanks> resultRanks();
   db_row getSourceData(int source);
   db_rows getSourcesData();
   db_rows getTextsData(int, int page = 0, int limit = 100);
   db_row getTextData(int);
+  //! the encoded KeystrokeLog of a result, empty if it has none.
+  QByteArray getKeystrokeLog(int result_id);
+  //! the key timings saved with a result, empty if it has none.
+  map<QString, KeyTiming> getKeyTimings(int result_id);
   QStringList getAllTexts(int source);
   int getTextsCount(int source);
   db_rows getPerformanceData(int, int, int, int, int = 10);
   db_rows getSourcesList();
   db_rows getStatisticsData(const QString&, amphetype::statistics::Type, int,
                             amphetype::statistics::Order, int);
+  /*! the statistics of every character, trigram and word of a text that was
+    typed in the last `days` days, fetched together in a single query. */
+  ngram_statistics textStatistics(const Text& text, int days = 30);
   map<QChar, map<QString, QVariant>> getKeyFrequency();
 
   //! Get one row with the given SQL and bind value(s).
@@ -146,24 +218,93 @@ class Database : public QObject {
   shared_ptr<Text> textFromStats(amphetype::statistics::Order order,
                                  int count = 10, int days = 30,
                                  int length = 80);
+  /*! Get a library text that covers the most of the damaging trigrams and
+    words of the statistics, picked at random from the best few.
+    \param last a text to avoid picking again.
+    \param days the number of days back to get statistics for.
+  */
+  shared_ptr<Text> textForWeakSpots(const Text* last = nullptr,
+                                    int days = 30);
+  /*! the trigram and word index of the enabled library texts, built when
+    it's first needed. */
+  shared_ptr<TextIndex> textIndex();
+  /*! Get a text of the words that are due for review, the most overdue
+    first, or of the most damaging words when none are due.
+    \param count the number of words to get.
+    \param length the approximate length of the resulting text.
+  */
+  shared_ptr<Text> textFromReviews(int count = 10, int length = 80);
+  //! the review schedule of the profile, loaded when it's first needed.
+  shared_ptr<ReviewSchedule> reviewSchedule();
   //! compress the statistics data in the database.
   void compress();
+  /*! Move results, statistics and mistakes older than `days` days into the
+    archive database next to the profile. Statistics and mistakes are
+    replaced by daily rollups in the profile, archived results are still
+    included by the views through the archive. */
+  void archive(int days);
+  /*! merge the sources, texts, results, statistics, mistakes, keystroke
+    logs and reviews of another profile file into this one. Sources are
+    matched by name and texts by content, rows that were merged before are
+    skipped. */
+  bool mergeProfile(const QString& path);
   //! bind values to a sql query and execute it.
   void bindAndRun(const QString& sql, const QVariant& = QVariant());
   void bindAndRun(const QString& sql, const db_row& values);
 
  private:
   QString make_db_path(const QString& name = QString());
+  //! the archive database that belongs to the profile.
+  QString archivePath() const;
+  //! the table to read results from, including archived ones if any.
+  QString resultTable() const;
+  /*! a query for the w, wpm, accuracy and viscosity of the latest `?1`
+    results, newest first and including archived ones. */
+  QString latestResults() const;
+  /*! the id of an ngram in the ngram dictionary, adding it if needed.
+    ids that were added are put in `added` until their transaction commits. */
+  long long ngramId(const QString& ngram, int type, ngram_ids* added);
+  //! update the result statistics once a saved result is committed.
+  void resultAdded(TestResult* result);
+  //! reload the result statistics after results were changed or deleted.
+  void resultsChanged();
+  //! rebuild the text index after texts were added, changed or deleted.
+  void textsChanged();
+  //! insert the result of a test, its keystrokes and key timings, dated `w`.
+  void insertResult(TestResult* result, const QVariant& w, ngram_ids* added);
+  //! run `cmd` for each key timing of `result` with the id of the result.
+  void insertKeyTimings(command* cmd, TestResult* result, ngram_ids* added);
+  /*! run `cmd` for each ngram of `result` with its time, viscosity, count,
+    mistakes and ngram id followed by `last` and the id of the result. */
+  void insertStatistics(command* cmd, TestResult* result, const QVariant& last,
+                        ngram_ids* added);
+  /*! grade the words of `result` that are scheduled or were typed poorly,
+    running `cmd` with each new review and adding them to `reviewed`. */
+  void insertReviews(command* cmd, TestResult* result, ngram_ids* added,
+                     vector<ReviewSchedule::Entry>* reviewed);
+  /*! run `cmd` for each mistake with its target, mistake, count, `last` and
+    the id of the result. */
+  void insertMistakes(command* cmd, TestResult* result, const QVariant& last);
+  //! (re)create the views used by the models.
+  void createViews();
   void bind(statement*, const db_row&, vector<string>&) const;
   //! bind values to a command and execute it.
   void bindAndRun(command* cmd, const db_row& values);
   void bindAndRun(command* cmd, const QVariant& value = QVariant());
+  //! bind values to a command and execute it, throwing if it fails.
+  void execute(command* cmd, const db_row& values);
   //! create a text object with a given query with optional bound values.
   shared_ptr<Text> getTextWithQuery(const QString&,
                                     const QVariant& = QVariant());
 
  private:
+  QString path_;
   unique_ptr<DBConnection> conn_;
+  shared_ptr<NgramDictionary> ngrams_;
+  shared_ptr<RecentResults> recent_;
+  shared_ptr<ResultRanks> ranks_;
+  shared_ptr<TextIndex> index_;
+  shared_ptr<ReviewSchedule> reviews_;
 };
 
 #endif  // SRC_DATABASE_DB_H_
@@ -0,0 +1,65 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_DATABASE_MIGRATIONCONTROLLER_H_
+#define SRC_DATABASE_MIGRATIONCONTROLLER_H_
+
+#include <QObject>
+#include <QString>
+#include <QThread>
+
+#include <memory>
+
+#include "database/migrations.h"
+
+class MigrationController : public QObject {
+  Q_OBJECT
+
+ public:
+  explicit MigrationController(const QString& profile)
+      : profile_(profile), migrator_(std::make_unique<Migrator>()) {
+    migrator_->moveToThread(&thread_);
+    connect(this, &MigrationController::operate, migrator_.get(),
+            &Migrator::doWork);
+    connect(migrator_.get(), &Migrator::resultReady, this,
+            &MigrationController::done);
+    connect(migrator_.get(), &Migrator::progress, this,
+            &MigrationController::progressUpdate);
+    thread_.start();
+  }
+
+  ~MigrationController() {
+    thread_.quit();
+    thread_.wait();
+  }
+
+ private:
+  QString profile_;
+  std::unique_ptr<Migrator> migrator_;
+  QThread thread_;
+
+ public slots:
+  void start() { emit operate(profile_); }
+
+ signals:
+  void operate(const QString&);
+  void done(bool);
+  void progressUpdate(int);
+};
+
+#endif  // SRC_DATABASE_MIGRATIONCONTROLLER_H_
@@ -0,0 +1,577 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "database/migrations.h"
+
+#include <algorithm>
+
+#include <QsLog.h>
+
+#include "database/db.h"
+
+using sqlite3pp::command;
+using sqlite3pp::database;
+using sqlite3pp::database_error;
+using sqlite3pp::query;
+
+namespace {
+
+// rows copied per transaction by the chunked migrations.
+static constexpr const long long kChunkSize = 20000;
+
+void exec(database& db, const char* sql) {
+  if (db.execute(sql) != SQLITE_OK) throw database_error(db);
+}
+
+void exec(database& db, const char* sql, long long a, long long b) {
+  command cmd(db, sql);
+  cmd.bind(1, a);
+  cmd.bind(2, b);
+  if (cmd.execute() != SQLITE_OK) throw database_error(db);
+}
+
+long long scalar(database& db, const char* sql) {
+  query qry(db, sql);
+  for (const auto& row : qry) return row.get<long long>(0);
+  return 0;
+}
+
+// The schema as it was before versioning. Every statement is guarded so
+// that it can be applied on top of a profile created by an older version.
+long long initialSchema(database& db, long long) {
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS source("
+       "id         INTEGER PRIMARY KEY,"
+       "name       TEXT,"
+       "disabled   INTEGER,"
+       "discount   INTEGER,"
+       "type       INTEGER,"
+       "text_count INTEGER)");
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS text("
+       "id       INTEGER PRIMARY KEY,"
+       "source   INTEGER REFERENCES source(id) ON DELETE CASCADE,"
+       "text     TEXT,"
+       "disabled INTEGER)");
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS result("
+       "id        INTEGER PRIMARY KEY,"
+       "w         DATETIME,"
+       "text_id   INTEGER REFERENCES text(id) ON DELETE CASCADE,"
+       "source    INTEGER REFERENCES source(id),"
+       "wpm       REAL,"
+       "accuracy  REAL,"
+       "viscosity REAL)");
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS statistic("
+       "w         DATETIME,"
+       "data      TEXT,"
+       "type      INTEGER,"
+       "time      REAL,"
+       "count     INTEGER,"
+       "mistakes  INTEGER,"
+       "viscosity REAL)");
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS mistake("
+       "w       DATETIME,"
+       "target  TEXT,"
+       "mistake TEXT,"
+       "count   INTEGER)");
+  exec(db,
+       "CREATE TRIGGER IF NOT EXISTS text_count_add_trigger "
+       "BEFORE INSERT ON text "
+       "FOR EACH ROW "
+       "BEGIN "
+       "  UPDATE source set text_count = text_count + 1 where id = "
+       "  NEW.source; "
+       "END;");
+  exec(db,
+       "CREATE TRIGGER IF NOT EXISTS text_count_subtract_trigger "
+       "BEFORE DELETE ON text "
+       "FOR EACH ROW "
+       "BEGIN "
+       "  UPDATE source set text_count = text_count - 1 where id = "
+       "  OLD.source; "
+       "END;");
+  exec(db,
+       "CREATE TRIGGER IF NOT EXISTS invalidate_result_trigger "
+       "AFTER UPDATE OF text ON text "
+       "FOR EACH ROW "
+       "BEGIN "
+       "  UPDATE result set source = NULL, text_id = NULL where text_id = "
+       "  NEW.id; "
+       "END;");
+  return migrations::kDone;
+}
+
+// Indexes for the foreign keys used by ON DELETE CASCADE and the columns the
+// views and statistics queries filter on.
+long long addIndexes(database& db, long long) {
+  exec(db, "CREATE INDEX IF NOT EXISTS text_source_idx ON text(source)");
+  exec(db, "CREATE INDEX IF NOT EXISTS result_text_idx ON result(text_id)");
+  exec(db, "CREATE INDEX IF NOT EXISTS result_source_idx ON result(source)");
+  exec(db, "CREATE INDEX IF NOT EXISTS result_w_idx ON result(w)");
+  exec(db,
+       "CREATE INDEX IF NOT EXISTS statistic_type_w_idx "
+       "ON statistic(type, w)");
+  exec(db, "CREATE INDEX IF NOT EXISTS mistake_w_idx ON mistake(w)");
+  return migrations::kDone;
+}
+
+// Move the ngram strings of statistic rows into the ngram dictionary. The new
+// table is filled in rowid chunks next to the old one, which stays readable
+// until both are swapped in the final step.
+long long ngramDictionary(database& db, long long cursor) {
+  if (!cursor) {
+    exec(db,
+         "CREATE TABLE IF NOT EXISTS ngram("
+         "id     INTEGER PRIMARY KEY,"
+         "text   TEXT,"
+         "type   INTEGER,"
+         "length INTEGER,"
+         "UNIQUE (text, type))");
+    exec(db, "DROP TABLE IF EXISTS statistic_ngram");
+    exec(db,
+         "CREATE TABLE statistic_ngram("
+         "w         DATETIME,"
+         "ngram     INTEGER REFERENCES ngram(id),"
+         "time      REAL,"
+         "count     INTEGER,"
+         "mistakes  INTEGER,"
+         "viscosity REAL)");
+  }
+
+  if (cursor < scalar(db, "SELECT max(rowid) FROM statistic")) {
+    long long end = cursor + kChunkSize;
+    exec(db,
+         "INSERT OR IGNORE INTO ngram (text, type, length) "
+         "SELECT data, type, length(data) FROM statistic "
+         "WHERE rowid > ? AND rowid <= ?",
+         cursor, end);
+    exec(db,
+         "INSERT INTO statistic_ngram "
+         "SELECT w, ngram.id, time, count, mistakes, viscosity "
+         "FROM statistic "
+         "JOIN ngram ON (ngram.text = statistic.data "
+         "               AND ngram.type = statistic.type) "
+         "WHERE statistic.rowid > ? AND statistic.rowid <= ?",
+         cursor, end);
+    return end;
+  }
+
+  exec(db, "DROP VIEW IF EXISTS statisticView");
+  exec(db, "DROP TABLE statistic");
+  exec(db, "ALTER TABLE statistic_ngram RENAME TO statistic");
+  exec(db, "CREATE INDEX statistic_w_idx ON statistic(w)");
+  exec(db, "CREATE INDEX statistic_ngram_idx ON statistic(ngram)");
+  migrations::createViews(db, 3);
+  return migrations::kDone;
+}
+
+long long statisticRows(database& db) {
+  return scalar(db, "SELECT max(rowid) FROM statistic");
+}
+
+// Aggregates of rows that were moved to the archive.
+long long rollupTables(database& db, long long) {
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS statistic_rollup("
+       "w         DATETIME,"
+       "ngram     INTEGER REFERENCES ngram(id),"
+       "time      REAL,"
+       "count     INTEGER,"
+       "mistakes  INTEGER,"
+       "viscosity REAL)");
+  exec(db,
+       "CREATE INDEX IF NOT EXISTS statistic_rollup_w_idx "
+       "ON statistic_rollup(w)");
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS mistake_rollup("
+       "w       DATETIME,"
+       "target  TEXT,"
+       "mistake TEXT,"
+       "count   INTEGER)");
+  return migrations::kDone;
+}
+
+// Sources are deleted in chunks of texts with the text count fixed once a
+// chunk, see createTextCountTrigger. The trigger first skipped the sources
+// being deleted with a condition, which cost a lookup for every deleted text.
+long long textCountTrigger(database& db, long long) {
+  exec(db, "DROP TRIGGER IF EXISTS text_count_subtract_trigger");
+  migrations::createTextCountTrigger(db);
+  return migrations::kDone;
+}
+
+// Raw keystrokes of each result, see KeystrokeLog. They go with their result
+// when it's deleted.
+long long keystrokeLog(database& db, long long) {
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS keystroke_log("
+       "result_id INTEGER PRIMARY KEY,"
+       "data      BLOB)");
+  exec(db,
+       "CREATE TRIGGER IF NOT EXISTS keystroke_log_delete_trigger "
+       "AFTER DELETE ON result "
+       "FOR EACH ROW "
+       "BEGIN "
+       "  DELETE FROM keystroke_log WHERE result_id = OLD.id; "
+       "END;");
+  return migrations::kDone;
+}
+
+// When each weak ngram is due for practice again, see ReviewSchedule.
+long long reviewSchedule(database& db, long long) {
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS review("
+       "ngram    INTEGER PRIMARY KEY,"
+       "due      DATETIME,"
+       "interval REAL,"
+       "ease     REAL,"
+       "reps     INTEGER,"
+       "lapses   INTEGER)");
+  return migrations::kDone;
+}
+
+long long resultRows(database& db) {
+  return scalar(db, "SELECT max(id) FROM result");
+}
+
+bool attached(database& db, const char* name) {
+  query qry(db, "PRAGMA database_list");
+  for (const auto& row : qry)
+    if (QString(row.get<char const*>(1)) == name) return true;
+  return false;
+}
+
+// Result ids were handed out again once every result was archived, clashing
+// with the archived results. AUTOINCREMENT keeps them growing, and the
+// sequence starts after the archived ids too. The new table is filled in id
+// chunks next to the old one, like the ngram dictionary.
+long long autoincrementResults(database& db, long long cursor) {
+  if (!cursor) {
+    exec(db, "DROP TABLE IF EXISTS result_autoincrement");
+    exec(db,
+         "CREATE TABLE result_autoincrement("
+         "id        INTEGER PRIMARY KEY AUTOINCREMENT,"
+         "w         DATETIME,"
+         "text_id   INTEGER REFERENCES text(id) ON DELETE CASCADE,"
+         "source    INTEGER REFERENCES source(id),"
+         "wpm       REAL,"
+         "accuracy  REAL,"
+         "viscosity REAL)");
+  }
+
+  if (cursor < scalar(db, "SELECT max(id) FROM result")) {
+    long long end = cursor + kChunkSize;
+    exec(db,
+         "INSERT INTO result_autoincrement "
+         "SELECT id, w, text_id, source, wpm, accuracy, viscosity "
+         "FROM result WHERE id > ? AND id <= ?",
+         cursor, end);
+    return end;
+  }
+
+  long long last = scalar(db, "SELECT coalesce(max(id), 0) FROM result");
+  if (attached(db, "archive")) {
+    last = std::max(
+        last, scalar(db, "SELECT coalesce(max(id), 0) FROM archive.result"));
+  }
+  // triggers don't fire for the rows dropped with the table.
+  exec(db, "DROP TABLE result");
+  exec(db, "ALTER TABLE result_autoincrement RENAME TO result");
+  exec(db, "CREATE INDEX IF NOT EXISTS result_text_idx ON result(text_id)");
+  exec(db, "CREATE INDEX IF NOT EXISTS result_source_idx ON result(source)");
+  exec(db, "CREATE INDEX IF NOT EXISTS result_w_idx ON result(w)");
+  exec(db,
+       "CREATE TRIGGER IF NOT EXISTS keystroke_log_delete_trigger "
+       "AFTER DELETE ON result "
+       "FOR EACH ROW "
+       "BEGIN "
+       "  DELETE FROM keystroke_log WHERE result_id = OLD.id; "
+       "END;");
+  exec(db, "DELETE FROM sqlite_sequence WHERE name = 'result'");
+  command seq(db, "INSERT INTO sqlite_sequence (name, seq) VALUES (?, ?)");
+  seq.bind(1, "result", sqlite3pp::nocopy);
+  seq.bind(2, last);
+  if (seq.execute() != SQLITE_OK) throw database_error(db);
+  return migrations::kDone;
+}
+
+// Statistics and mistakes point at the result they were saved with, so that
+// a replayed result replaces exactly its own rows. Rows saved before are
+// linked when they're of a result with a keystroke log, the only ones that can
+// be replayed, and no other result was saved at the same time.
+long long linkResults(database& db, long long) {
+  exec(db, "ALTER TABLE statistic ADD COLUMN result_id INTEGER");
+  exec(db, "ALTER TABLE mistake ADD COLUMN result_id INTEGER");
+  exec(db,
+       "CREATE INDEX IF NOT EXISTS statistic_result_idx "
+       "ON statistic(result_id)");
+  exec(db,
+       "CREATE INDEX IF NOT EXISTS mistake_result_idx ON mistake(result_id)");
+  for (const char* table : {"statistic", "mistake"}) {
+    exec(db, QString("UPDATE %1 SET result_id = ("
+                     " SELECT id FROM result WHERE result.w = %1.w) "
+                     "WHERE w IN ("
+                     " SELECT result.w FROM keystroke_log "
+                     " JOIN result ON (result.id = keystroke_log.result_id)) "
+                     "AND w NOT IN ("
+                     " SELECT w FROM result GROUP BY w HAVING count() > 1)")
+                 .arg(table)
+                 .toUtf8()
+                 .constData());
+  }
+  return migrations::kDone;
+}
+
+// How long the keys of each result were held and the gaps between them, see
+// KeyTiming. They go with their result when it's deleted.
+long long keyTimings(database& db, long long) {
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS key_timing("
+       "result_id INTEGER,"
+       "ngram     INTEGER REFERENCES ngram(id),"
+       "count     INTEGER,"
+       "dwell     REAL,"
+       "flight    REAL,"
+       "overlaps  INTEGER,"
+       "PRIMARY KEY (result_id, ngram))");
+  exec(db,
+       "CREATE TRIGGER IF NOT EXISTS key_timing_delete_trigger "
+       "AFTER DELETE ON result "
+       "FOR EACH ROW "
+       "BEGIN "
+       "  DELETE FROM key_timing WHERE result_id = OLD.id; "
+       "END;");
+  return migrations::kDone;
+}
+
+// The views built on results, in `schema`, reading results from `results`.
+void createResultViews(database& db, const QString& schema,
+                       const QString& results) {
+  exec(db, QString("DROP VIEW IF EXISTS %1.performanceView; "
+                   "CREATE VIEW %1.performanceView as SELECT "
+                   "result.id,"
+                   "text_id,"
+                   "source.id as source_id,"
+                   "w as date,"
+                   "source.name as source_name,"
+                   "source.type,"
+                   "wpm,"
+                   "100.0 * accuracy as accuracy,"
+                   "viscosity "
+                   "FROM %2 as result "
+                   "LEFT JOIN source ON (result.source = source.id)")
+               .arg(schema, results)
+               .toUtf8()
+               .constData());
+
+  exec(db, QString("DROP VIEW IF EXISTS %1.sourceView; "
+                   "CREATE VIEW %1.sourceView as "
+                   "SELECT source.id, name as name_editable, "
+                   " text_count as Texts, count(wpm) as Results, "
+                   " nullif(round(agg_median(wpm), 1), 0) as WPM, "
+                   " (CASE WHEN text_count > 0 AND NOT EXISTS ("
+                   "   SELECT 1 FROM text WHERE text.source = source.id "
+                   "   AND text.disabled IS NULL) THEN 'yes' ELSE NULL END) "
+                   "   as Disabled, "
+                   " type as Type "
+                   "FROM source "
+                   "LEFT JOIN %2 as result ON (source.id = result.source) "
+                   "WHERE source.disabled IS NULL "
+                   "GROUP BY source.id")
+               .arg(schema, results)
+               .toUtf8()
+               .constData());
+
+  exec(db, QString("DROP VIEW IF EXISTS %1.textView; "
+                   "CREATE VIEW %1.textView as "
+                   "SELECT text.id, "
+                   " substr(text, 0, 30) || '...' as text_editable, "
+                   " length(text) as length, count(wpm) as results, "
+                   " nullif(round(agg_median(wpm), 1), 0) as wpm, "
+                   " (CASE WHEN disabled = 1 THEN 'yes' ELSE NULL END) "
+                   "   as disabled, "
+                   " text.source as source "
+                   "FROM text "
+                   "LEFT JOIN %2 as result ON (text.id = result.text_id) "
+                   "GROUP BY text.id")
+               .arg(schema, results)
+               .toUtf8()
+               .constData());
+}
+
+}  // namespace
+
+namespace migrations {
+
+const std::vector<Migration>& all() {
+  static const std::vector<Migration> list = {
+      {1, "initial schema", false, &initialSchema, nullptr},
+      {2, "add indexes", true, &addIndexes, nullptr},
+      {3, "ngram dictionary", true, &ngramDictionary, &statisticRows},
+      {4, "rollup tables", false, &rollupTables, nullptr},
+      {5, "skip text count of deleted sources", false, &textCountTrigger,
+       nullptr},
+      {6, "keystroke log", false, &keystrokeLog, nullptr},
+      {7, "review schedule", false, &reviewSchedule, nullptr},
+      {8, "autoincrement result ids", true, &autoincrementResults,
+       &resultRows},
+      {9, "link statistics to results", false, &linkResults, nullptr},
+      {10, "key timings", false, &keyTimings, nullptr},
+      {11, "text count trigger without condition", false, &textCountTrigger,
+       nullptr},
+  };
+  return list;
+}
+
+int latestVersion() { return all().back().version; }
+
+void createViews(database& db, int version) {
+  createResultViews(db, "main", "result");
+
+  // statistic rows with their ngram. `ngram` is what to group by, the
+  // dictionary id once it exists and the ngram itself before that.
+  if (version >= 4) {
+    exec(db,
+         "DROP VIEW IF EXISTS statisticView; "
+         "CREATE VIEW statisticView as "
+         "SELECT w, ngram.text as data, ngram.type as type, time, count, "
+         " mistakes, viscosity, statistic.ngram as ngram "
+         "FROM statistic "
+         "JOIN ngram ON (statistic.ngram = ngram.id) "
+         "UNION ALL "
+         "SELECT w, ngram.text, ngram.type, time, count, mistakes, viscosity, "
+         " statistic_rollup.ngram "
+         "FROM statistic_rollup "
+         "JOIN ngram ON (statistic_rollup.ngram = ngram.id)");
+  } else if (version >= 3) {
+    exec(db,
+         "DROP VIEW IF EXISTS statisticView; "
+         "CREATE VIEW statisticView as "
+         "SELECT w, ngram.text as data, ngram.type as type, time, count, "
+         " mistakes, viscosity, statistic.ngram as ngram "
+         "FROM statistic "
+         "JOIN ngram ON (statistic.ngram = ngram.id)");
+  } else {
+    exec(db,
+         "DROP VIEW IF EXISTS statisticView; "
+         "CREATE VIEW statisticView as "
+         "SELECT w, data, type, time, count, mistakes, viscosity, "
+         " data as ngram "
+         "FROM statistic");
+  }
+}
+
+void createArchive(database& db) {
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS archive.result("
+       "id        INTEGER PRIMARY KEY,"
+       "w         DATETIME,"
+       "text_id   INTEGER,"
+       "source    INTEGER,"
+       "wpm       REAL,"
+       "accuracy  REAL,"
+       "viscosity REAL)");
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS archive.statistic("
+       "w         DATETIME,"
+       "ngram     INTEGER,"
+       "time      REAL,"
+       "count     INTEGER,"
+       "mistakes  INTEGER,"
+       "viscosity REAL)");
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS archive.mistake("
+       "w       DATETIME,"
+       "target  TEXT,"
+       "mistake TEXT,"
+       "count   INTEGER)");
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS archive.keystroke_log("
+       "result_id INTEGER PRIMARY KEY,"
+       "data      BLOB)");
+  exec(db,
+       "CREATE TRIGGER IF NOT EXISTS archive.keystroke_log_delete_trigger "
+       "AFTER DELETE ON result "
+       "FOR EACH ROW "
+       "BEGIN "
+       "  DELETE FROM keystroke_log WHERE result_id = OLD.id; "
+       "END;");
+  exec(db,
+       "CREATE TABLE IF NOT EXISTS archive.key_timing("
+       "result_id INTEGER,"
+       "ngram     INTEGER,"
+       "count     INTEGER,"
+       "dwell     REAL,"
+       "flight    REAL,"
+       "overlaps  INTEGER,"
+       "PRIMARY KEY (result_id, ngram))");
+  exec(db,
+       "CREATE TRIGGER IF NOT EXISTS archive.key_timing_delete_trigger "
+       "AFTER DELETE ON result "
+       "FOR EACH ROW "
+       "BEGIN "
+       "  DELETE FROM key_timing WHERE result_id = OLD.id; "
+       "END;");
+  exec(db, "CREATE INDEX IF NOT EXISTS archive.result_w_idx ON result(w)");
+  exec(db,
+       "CREATE INDEX IF NOT EXISTS archive.result_source_idx "
+       "ON result(source)");
+  exec(db,
+       "CREATE INDEX IF NOT EXISTS archive.statistic_w_idx "
+       "ON statistic(w)");
+  exec(db, "CREATE INDEX IF NOT EXISTS archive.mistake_w_idx ON mistake(w)");
+}
+
+void createHistoryViews(database& db) {
+  exec(db,
+       "DROP VIEW IF EXISTS temp.resultHistory; "
+       "CREATE VIEW temp.resultHistory as "
+       "SELECT id, w, text_id, source, wpm, accuracy, viscosity "
+       "FROM main.result "
+       "UNION ALL "
+       "SELECT id, w, text_id, source, wpm, accuracy, viscosity "
+       "FROM archive.result");
+  createResultViews(db, "temp", "resultHistory");
+}
+
+void createTextCountTrigger(database& db) {
+  exec(db,
+       "CREATE TRIGGER text_count_subtract_trigger "
+       "BEFORE DELETE ON text "
+       "FOR EACH ROW "
+       "BEGIN "
+       "  UPDATE source set text_count = text_count - 1 where id = "
+       "  OLD.source; "
+       "END;");
+}
+
+}  // namespace migrations
+
+Migrator::Migrator(QObject* parent) : QObject(parent) {}
+
+void Migrator::doWork(const QString& profile) {
+  Database db(profile);
+  bool ok = db.migrate(true, [this](int percent) { emit progress(percent); });
+  QLOG_INFO() << "Migrator: profile" << profile
+              << (ok ? "migrated to version" : "failed at version")
+              << db.schemaVersion();
+  emit resultReady(ok);
+}
@@ -0,0 +1,88 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_DATABASE_MIGRATIONS_H_
+#define SRC_DATABASE_MIGRATIONS_H_
+
+#include <QObject>
+#include <QString>
+
+#include <functional>
+#include <vector>
+
+#include <sqlite3pp.h>
+
+namespace migrations {
+
+//! returned by a migration step once there is nothing left to do.
+static constexpr const long long kDone = -1;
+
+/*! A single schema change, identified by the `PRAGMA user_version` it
+  upgrades the database to.
+
+  `step` is called repeatedly inside its own short transaction with the cursor
+  returned by the previous call (starting at 0) until it returns kDone. The
+  cursor is persisted between calls, so an interrupted migration resumes where
+  it left off. Quick migrations can simply do all their work and return kDone.
+
+  `size` optionally returns the value the cursor counts towards and is only
+  used for progress reporting.
+*/
+struct Migration {
+  int version;
+  QString description;
+  //! long migrations are run by a Migrator in the background.
+  bool background;
+  std::function<long long(sqlite3pp::database&, long long cursor)> step;
+  std::function<long long(sqlite3pp::database&)> size;
+};
+
+//! all known migrations, ordered by version.
+const std::vector<Migration>& all();
+//! the schema version a fully migrated database has.
+int latestVersion();
+//! (re)create the views for a database at the given schema version.
+void createViews(sqlite3pp::database& db, int version);
+//! create the tables of the archive database attached as `archive`.
+void createArchive(sqlite3pp::database& db);
+/*! create temporary views that shadow the result views with ones that
+  include the archived results. */
+void createHistoryViews(sqlite3pp::database& db);
+/*! (re)create the trigger that counts the texts of a source down when one
+  is deleted. Database::deleteSource drops it while it deletes texts in
+  chunks and counts each chunk down at once. */
+void createTextCountTrigger(sqlite3pp::database& db);
+
+}  // namespace migrations
+
+//! Runs the pending migrations of a profile, for use on a worker thread.
+class Migrator : public QObject {
+  Q_OBJECT
+
+ public:
+  explicit Migrator(QObject* parent = Q_NULLPTR);
+
+ signals:
+  void progress(int);
+  void resultReady(bool);
+
+ public slots:
+  void doWork(const QString& profile);
+};
+
+#endif  // SRC_DATABASE_MIGRATIONS_H_
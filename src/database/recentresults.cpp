@@ -0,0 +1,210 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "database/recentresults.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// the buckets of each metric, at the precision they're shown with.
+static constexpr const double kResolution = 0.1;
+static constexpr const double kMaxWpm = 500.0;
+static constexpr const double kMaxAccuracy = 100.0;
+static constexpr const double kMaxViscosity = 1000.0;
+}  // namespace
+
+BucketCounts::BucketCounts(double max, double resolution)
+    : resolution_(resolution),
+      tree_(static_cast<int>(std::ceil(max / resolution)) + 2, 0) {}
+
+void BucketCounts::add(double value, int delta) {
+  for (int i = bucket(value) + 1; i < static_cast<int>(tree_.size());
+       i += i & -i)
+    tree_[i] += delta;
+  total_ += delta;
+}
+
+void BucketCounts::clear() {
+  std::fill(tree_.begin(), tree_.end(), 0);
+  total_ = 0;
+}
+
+double BucketCounts::select(int k) const {
+  int n = static_cast<int>(tree_.size()) - 1;
+  int step = 1;
+  while (step * 2 <= n) step *= 2;
+  int position = 0;
+  for (; step; step /= 2) {
+    if (position + step <= n && tree_[position + step] < k) {
+      position += step;
+      k -= tree_[position];
+    }
+  }
+  // position is the last 1-based index with fewer than k values up to it, so
+  // the value is in the next one, which is bucket `position`.
+  return position * resolution_;
+}
+
+int BucketCounts::bucket(double value) const {
+  int last = static_cast<int>(tree_.size()) - 2;
+  return std::min(last, std::max(0, static_cast<int>(
+                                        std::lround(value / resolution_))));
+}
+
+int BucketCounts::prefix(int buckets) const {
+  int count = 0;
+  for (int i = buckets; i > 0; i -= i & -i) count += tree_[i];
+  return count;
+}
+
+RollingWindow::RollingWindow(int size, double max, double resolution)
+    : counts_(max, resolution), values_(std::max(1, size)) {}
+
+void RollingWindow::add(double value) {
+  if (count() == static_cast<int>(values_.size()))
+    counts_.add(values_[next_], -1);
+  values_[next_] = value;
+  counts_.add(value);
+  next_ = (next_ + 1) % values_.size();
+}
+
+void RollingWindow::clear() {
+  counts_.clear();
+  next_ = 0;
+}
+
+double RollingWindow::percentile(double p) const {
+  int count = this->count();
+  if (!count) return 0.0;
+  int k = static_cast<int>(std::ceil(p * count));
+  return counts_.select(std::min(count, std::max(1, k)));
+}
+
+double RollingWindow::median() const {
+  int count = this->count();
+  if (!count) return 0.0;
+  int k = (count + 1) / 2;
+  return count & 1 ? counts_.select(k)
+                   : (counts_.select(k) + counts_.select(k + 1)) / 2.0;
+}
+
+BucketCounts RecentResults::counts(Metric metric) {
+  switch (metric) {
+    case Accuracy:
+      return BucketCounts(kMaxAccuracy, kResolution);
+    case Viscosity:
+      return BucketCounts(kMaxViscosity, kResolution);
+    default:
+      return BucketCounts(kMaxWpm, kResolution);
+  }
+}
+
+RecentResults::RecentResults(const vector<int>& sizes) : sizes_(sizes) {
+  if (sizes_.empty()) sizes_.push_back(10);
+  std::sort(sizes_.begin(), sizes_.end());
+  for (int size : sizes_) {
+    windows_.push_back({{RollingWindow(size, kMaxWpm, kResolution),
+                         RollingWindow(size, kMaxAccuracy, kResolution),
+                         RollingWindow(size, kMaxViscosity, kResolution)}});
+  }
+}
+
+void RecentResults::add(double wpm, double accuracy, double viscosity) {
+  QMutexLocker locker(&lock_);
+  if (!loaded_) {
+    if (loading_) pending_.push_back({{wpm, accuracy, viscosity}});
+    return;
+  }
+  for (auto& windows : windows_) {
+    windows[Wpm].add(wpm);
+    windows[Accuracy].add(accuracy);
+    windows[Viscosity].add(viscosity);
+  }
+}
+
+quint64 RecentResults::beginLoad() {
+  QMutexLocker locker(&lock_);
+  if (!loading_++) pending_.clear();
+  return generation_;
+}
+
+void RecentResults::load(const vector<std::array<double, 3>>& results,
+                         quint64 generation) {
+  QMutexLocker locker(&lock_);
+  --loading_;
+  if (generation != generation_ || loaded_) return;
+  // the first results saved while these were read may have been read too,
+  // as the newest of them.
+  size_t overlap = std::min(pending_.size(), results.size());
+  while (overlap && !std::equal(pending_.begin(), pending_.begin() + overlap,
+                                results.end() - overlap))
+    --overlap;
+  vector<std::array<double, 3>> all(results);
+  all.insert(all.end(), pending_.begin() + overlap, pending_.end());
+  pending_.clear();
+  for (auto& windows : windows_) {
+    for (auto& window : windows) window.clear();
+    // only the last results fit in the window anyway.
+    size_t skip = all.size() - std::min(all.size(), windows[Wpm].capacity());
+    for (size_t i = skip; i < all.size(); ++i) {
+      for (int metric : {Wpm, Accuracy, Viscosity})
+        windows[metric].add(all[i][metric]);
+    }
+  }
+  loaded_ = true;
+}
+
+void RecentResults::invalidate() {
+  QMutexLocker locker(&lock_);
+  loaded_ = false;
+  ++generation_;
+  // the results are read again, saved ones that were kept are included.
+  pending_.clear();
+}
+
+bool RecentResults::loaded() const {
+  QMutexLocker locker(&lock_);
+  return loaded_;
+}
+
+int RecentResults::count(int size) const {
+  QMutexLocker locker(&lock_);
+  auto w = window(Wpm, size);
+  return w ? w->count() : 0;
+}
+
+double RecentResults::median(Metric metric, int size) const {
+  QMutexLocker locker(&lock_);
+  auto w = window(metric, size);
+  return w ? w->median() : 0.0;
+}
+
+double RecentResults::percentile(Metric metric, int size, double p) const {
+  QMutexLocker locker(&lock_);
+  auto w = window(metric, size);
+  return w ? w->percentile(p) : 0.0;
+}
+
+const RollingWindow* RecentResults::window(Metric metric, int size) const {
+  auto it = std::lower_bound(sizes_.begin(), sizes_.end(), size);
+  if (it == sizes_.end() || *it != size) return nullptr;
+  return &windows_[it - sizes_.begin()][metric];
+}
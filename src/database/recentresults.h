@@ -0,0 +1,132 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_DATABASE_RECENTRESULTS_H_
+#define SRC_DATABASE_RECENTRESULTS_H_
+
+#include <QMutex>
+
+#include <array>
+#include <vector>
+
+using std::vector;
+
+/*! Counts of values in buckets of `resolution` from 0 to `max`, in a Fenwick
+  tree so that adding a value, counting the values under one and finding the
+  k-th smallest all take O(log buckets). Values past `max` are counted as
+  `max`.
+*/
+class BucketCounts {
+ public:
+  BucketCounts(double max, double resolution);
+  void add(double value, int delta = 1);
+  void clear();
+  int total() const { return total_; }
+  //! the number of values in buckets before the one of `value`.
+  int countBelow(double value) const { return prefix(bucket(value)); }
+  //! the number of values in buckets up to the one of `value`.
+  int countAtMost(double value) const { return prefix(bucket(value) + 1); }
+  //! the k-th smallest value counting from 1, rounded to its bucket.
+  double select(int k) const;
+
+ private:
+  int bucket(double value) const;
+  //! the number of values in the first `buckets` buckets.
+  int prefix(int buckets) const;
+
+  double resolution_;
+  vector<int> tree_;
+  int total_ = 0;
+};
+
+//! Order statistics of the last `size` values added, see BucketCounts.
+class RollingWindow {
+ public:
+  RollingWindow(int size, double max, double resolution);
+  void add(double value);
+  void clear();
+  //! the number of values in the window, at most its capacity.
+  int count() const { return counts_.total(); }
+  size_t capacity() const { return values_.size(); }
+  //! the smallest value that at least `p` (0 to 1) of the window is under.
+  double percentile(double p) const;
+  double median() const;
+
+ private:
+  BucketCounts counts_;
+  //! the values in the window, oldest at next_ once it's full.
+  vector<double> values_;
+  int next_ = 0;
+};
+
+/*! Rolling medians and percentiles of the wpm, accuracy and viscosity of the
+  most recent results of a profile, over windows of a few sizes. It's shared
+  by every Database opened on the profile, filled from the result table the
+  first time it's needed and kept up to date as results are saved. Results
+  saved while the table is read are kept and added once it's loaded, like in
+  ResultRanks.
+*/
+class RecentResults {
+ public:
+  enum Metric { Wpm, Accuracy, Viscosity };
+  //! counts fit for the values of `metric`, at the precision they're shown.
+  static BucketCounts counts(Metric metric);
+
+  explicit RecentResults(const vector<int>& sizes = {10, 100, 1000});
+  //! the window sizes, smallest first.
+  const vector<int>& sizes() const { return sizes_; }
+  //! the most results any window covers.
+  int capacity() const { return sizes_.back(); }
+  /*! add the newest result, kept while loading and ignored until loaded.
+    \param accuracy in percent. */
+  void add(double wpm, double accuracy, double viscosity);
+  /*! start loading the results, call before reading them. Saved results are
+    kept from now on until `load` is called with the returned generation. */
+  quint64 beginLoad();
+  /*! replace the results with `results` of wpm, accuracy and viscosity, oldest
+    first, read after `beginLoad` returned `generation`. Results saved since
+    then are added after them unless they're already the newest of
+    `results`. Ignored when the results were invalidated in between or
+    another load finished first. */
+  void load(const vector<std::array<double, 3>>& results, quint64 generation);
+  //! forget the results until they're loaded again.
+  void invalidate();
+  bool loaded() const;
+  //! the number of results in the window of `size`, 0 if it isn't tracked.
+  int count(int size) const;
+  double median(Metric metric, int size) const;
+  //! \param p from 0 to 1.
+  double percentile(Metric metric, int size, double p) const;
+
+ private:
+  const RollingWindow* window(Metric metric, int size) const;
+
+  mutable QMutex lock_;
+  vector<int> sizes_;
+  //! for each size, a window for each metric.
+  vector<std::array<RollingWindow, 3>> windows_;
+  bool loaded_ = false;
+  //! bumped by invalidate, loads of an older generation are dropped.
+  quint64 generation_ = 0;
+  //! the number of loads that are reading the results.
+  int loading_ = 0;
+  //! results saved while loading, oldest first.
+  vector<std::array<double, 3>> pending_;
+};
+
+#endif  // SRC_DATABASE_RECENTRESULTS_H_
@@ -0,0 +1,176 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "database/resultranks.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+
+namespace {
+bool higherIsBetter(ResultRanks::Metric metric) {
+  return metric != RecentResults::Viscosity;
+}
+
+bool sameEntry(const ResultRanks::Entry& a, const ResultRanks::Entry& b) {
+  return a.when == b.when && a.source == b.source && a.text == b.text &&
+         a.values == b.values;
+}
+}  // namespace
+
+ResultRanks::ResultRanks()
+    : all_{{RecentResults::counts(RecentResults::Wpm),
+            RecentResults::counts(RecentResults::Accuracy),
+            RecentResults::counts(RecentResults::Viscosity)}} {}
+
+quint64 ResultRanks::beginLoad() {
+  QMutexLocker locker(&lock_);
+  if (!loading_++) pending_.clear();
+  return generation_;
+}
+
+void ResultRanks::load(const vector<Entry>& results, quint64 generation) {
+  QMutexLocker locker(&lock_);
+  --loading_;
+  if (generation != generation_ || loaded_) return;
+  for (auto& counts : all_) counts.clear();
+  sources_.clear();
+  texts_.clear();
+  worst_ = best_ = Extreme();
+  for (const auto& result : results) insert(result);
+  // results saved while these were read, if they were saved too late to be
+  // read. There are only a few.
+  for (const auto& result : pending_) {
+    auto same = [&result](const Entry& e) { return sameEntry(e, result); };
+    if (std::none_of(results.begin(), results.end(), same)) insert(result);
+  }
+  pending_.clear();
+  loaded_ = true;
+}
+
+void ResultRanks::add(const Entry& result) {
+  QMutexLocker locker(&lock_);
+  if (loaded_)
+    insert(result);
+  else if (loading_)
+    pending_.push_back(result);
+}
+
+void ResultRanks::invalidate() {
+  QMutexLocker locker(&lock_);
+  loaded_ = false;
+  ++generation_;
+  // the results are read again, saved ones that were kept are included.
+  pending_.clear();
+}
+
+bool ResultRanks::loaded() const {
+  QMutexLocker locker(&lock_);
+  return loaded_;
+}
+
+int ResultRanks::count(Scope scope, int id) const {
+  QMutexLocker locker(&lock_);
+  if (scope == Scope::All) return all_[RecentResults::Wpm].total();
+  auto values = sorted(scope, id);
+  return values ? static_cast<int>((*values)[RecentResults::Wpm].size()) : 0;
+}
+
+double ResultRanks::best(Metric metric, Scope scope, int id) const {
+  QMutexLocker locker(&lock_);
+  return select(metric, scope, id, higherIsBetter(metric) ? -1 : 1);
+}
+
+double ResultRanks::worst(Metric metric, Scope scope, int id) const {
+  QMutexLocker locker(&lock_);
+  return select(metric, scope, id, higherIsBetter(metric) ? 1 : -1);
+}
+
+ResultRanks::Rank ResultRanks::rank(Metric metric, double value, Scope scope,
+                                    int id) const {
+  QMutexLocker locker(&lock_);
+  Rank rank;
+  if (scope == Scope::All) {
+    const auto& counts = all_[metric];
+    rank.count = counts.total();
+    rank.better = higherIsBetter(metric)
+                      ? rank.count - counts.countAtMost(value)
+                      : counts.countBelow(value);
+    return rank;
+  }
+  auto values = sorted(scope, id);
+  if (!values) return rank;
+  const auto& v = (*values)[metric];
+  rank.count = static_cast<int>(v.size());
+  rank.better =
+      higherIsBetter(metric)
+          ? static_cast<int>(v.end() -
+                             std::upper_bound(v.begin(), v.end(), value))
+          : static_cast<int>(std::lower_bound(v.begin(), v.end(), value) -
+                             v.begin());
+  return rank;
+}
+
+bool ResultRanks::wpmRange(Extreme* worst, Extreme* best) const {
+  QMutexLocker locker(&lock_);
+  if (!all_[RecentResults::Wpm].total()) return false;
+  *worst = worst_;
+  *best = best_;
+  return true;
+}
+
+void ResultRanks::insert(const Entry& result) {
+  double wpm = result.values[RecentResults::Wpm];
+  if (!all_[RecentResults::Wpm].total()) {
+    worst_ = best_ = Extreme{result.when, wpm};
+  } else if (wpm < worst_.wpm) {
+    worst_ = Extreme{result.when, wpm};
+  } else if (wpm > best_.wpm) {
+    best_ = Extreme{result.when, wpm};
+  }
+  auto& source = sources_[result.source];
+  auto& text = texts_[result.text];
+  for (int m = 0; m < 3; ++m) {
+    double value = result.values[m];
+    all_[m].add(value);
+    for (auto values : {&source[m], &text[m]}) {
+      values->insert(std::upper_bound(values->begin(), values->end(), value),
+                     value);
+    }
+  }
+}
+
+const ResultRanks::Sorted* ResultRanks::sorted(Scope scope, int id) const {
+  const auto& scopes = scope == Scope::Source ? sources_ : texts_;
+  auto it = scopes.constFind(id);
+  return it == scopes.constEnd() ? nullptr : &it.value();
+}
+
+double ResultRanks::select(Metric metric, Scope scope, int id, int k) const {
+  if (scope == Scope::All) {
+    const auto& counts = all_[metric];
+    if (!counts.total()) return 0.0;
+    return counts.select(k < 0 ? counts.total() + 1 + k : k);
+  }
+  auto values = sorted(scope, id);
+  if (!values) return 0.0;
+  const auto& v = (*values)[metric];
+  if (v.empty()) return 0.0;
+  int n = static_cast<int>(v.size());
+  return v[k < 0 ? n + k : k - 1];
+}
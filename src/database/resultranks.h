@@ -0,0 +1,122 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_DATABASE_RESULTRANKS_H_
+#define SRC_DATABASE_RESULTRANKS_H_
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+
+#include <array>
+#include <vector>
+
+#include "database/recentresults.h"
+
+using std::vector;
+
+/*! Order statistics of every result of a profile, to rank a result against
+  all of them, the ones of its source or the ones of its text. Ranks, bests
+  and worsts take O(log n). Like RecentResults it's shared by every Database
+  opened on the profile, filled from the results the first time it's needed,
+  added to as results are saved and reloaded after they're deleted. Results
+  saved while the results are read are kept and added once they're loaded.
+*/
+class ResultRanks {
+ public:
+  using Metric = RecentResults::Metric;
+  enum class Scope { All, Source, Text };
+
+  //! a result as it's ranked.
+  struct Entry {
+    QDateTime when;
+    int source;
+    int text;
+    //! wpm, accuracy in percent and viscosity, indexed by Metric.
+    std::array<double, 3> values;
+  };
+  //! where a value places among the results of a scope.
+  struct Rank {
+    //! the number of results that are strictly better.
+    int better = 0;
+    int count = 0;
+    //! the fraction of the results that are better.
+    double top() const {
+      return count ? static_cast<double>(better) / count : 0.0;
+    }
+  };
+  //! a best or worst wpm result.
+  struct Extreme {
+    QDateTime when;
+    double wpm = 0.0;
+  };
+
+  ResultRanks();
+  /*! start loading the results, call before reading them. Saved results are
+    kept from now on until `load` is called with the returned generation. */
+  quint64 beginLoad();
+  /*! replace the results with `results`, read after `beginLoad` returned
+    `generation`. Results saved since then are added unless `results`
+    already has them. Ignored when the ranks were invalidated in between or
+    another load finished first. */
+  void load(const vector<Entry>& results, quint64 generation);
+  //! add a saved result, kept while loading and ignored until loaded.
+  void add(const Entry& result);
+  //! forget the results until they're loaded again.
+  void invalidate();
+  bool loaded() const;
+  //! the number of results of the source or text `id` of the scope.
+  int count(Scope scope = Scope::All, int id = 0) const;
+  //! the best value of `metric`, 0 when there are no results.
+  double best(Metric metric, Scope scope = Scope::All, int id = 0) const;
+  //! the worst value of `metric`, 0 when there are no results.
+  double worst(Metric metric, Scope scope = Scope::All, int id = 0) const;
+  /*! how `value` would place among the results. Higher is better except for
+    viscosity. */
+  Rank rank(Metric metric, double value, Scope scope = Scope::All,
+            int id = 0) const;
+  //! the worst and best wpm results, false when there are none.
+  bool wpmRange(Extreme* worst, Extreme* best) const;
+
+ private:
+  //! the values of each metric of a source or text, sorted ascending.
+  using Sorted = std::array<vector<double>, 3>;
+
+  void insert(const Entry& result);
+  const Sorted* sorted(Scope scope, int id) const;
+  /*! the `k`-th smallest value of a scope counting from 1, or the `-k`-th
+    largest when `k` is negative. */
+  double select(Metric metric, Scope scope, int id, int k) const;
+
+  mutable QMutex lock_;
+  //! every result, bucketed like the RecentResults.
+  std::array<BucketCounts, 3> all_;
+  QHash<int, Sorted> sources_;
+  QHash<int, Sorted> texts_;
+  Extreme worst_;
+  Extreme best_;
+  bool loaded_ = false;
+  //! bumped by invalidate, loads of an older generation are dropped.
+  quint64 generation_ = 0;
+  //! the number of loads that are reading the results.
+  int loading_ = 0;
+  //! results saved while loading.
+  vector<Entry> pending_;
+};
+
+#endif  // SRC_DATABASE_RESULTRANKS_H_
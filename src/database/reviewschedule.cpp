@@ -0,0 +1,140 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "database/reviewschedule.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+//! a lapsed ngram comes back after 10 minutes.
+constexpr double kRelearnDays = 10.0 / (24 * 60);
+constexpr double kMinEase = 1.3;
+}  // namespace
+
+int ReviewSchedule::quality(int mistakes, double wpm, double test_wpm) {
+  if (mistakes) return 1;
+  if (test_wpm <= 0) return 5;
+  // against the speed of the test, so it doesn't depend on the day's form.
+  double relative = wpm / test_wpm;
+  if (relative < 0.7) return 2;
+  if (relative < 0.85) return 3;
+  if (relative < 1.0) return 4;
+  return 5;
+}
+
+Review ReviewSchedule::grade(Review review, int quality, qint64 now) {
+  if (quality < kPass) {
+    review.reps = 0;
+    ++review.lapses;
+    review.interval = kRelearnDays;
+  } else {
+    ++review.reps;
+    if (review.reps == 1)
+      review.interval = 1.0;
+    else if (review.reps == 2)
+      review.interval = 6.0;
+    else
+      review.interval *= review.ease;
+  }
+  int miss = 5 - quality;
+  review.ease =
+      std::max(kMinEase, review.ease + 0.1 - miss * (0.08 + miss * 0.02));
+  review.due = now + std::llround(review.interval * 24 * 60 * 60);
+  return review;
+}
+
+void ReviewSchedule::load(const vector<Entry>& entries) {
+  QMutexLocker locker(&lock_);
+  scheduled_.clear();
+  heap_.clear();
+  for (const auto& entry : entries) set(entry);
+  loaded_ = true;
+}
+
+void ReviewSchedule::update(const vector<Entry>& entries) {
+  QMutexLocker locker(&lock_);
+  if (!loaded_) return;
+  for (const auto& entry : entries) set(entry);
+  compact();
+}
+
+void ReviewSchedule::invalidate() {
+  QMutexLocker locker(&lock_);
+  loaded_ = false;
+}
+
+bool ReviewSchedule::loaded() const {
+  QMutexLocker locker(&lock_);
+  return loaded_;
+}
+
+int ReviewSchedule::size() const {
+  QMutexLocker locker(&lock_);
+  return scheduled_.size();
+}
+
+bool ReviewSchedule::find(long long id, Review* review) const {
+  QMutexLocker locker(&lock_);
+  auto it = scheduled_.constFind(id);
+  if (it == scheduled_.constEnd()) return false;
+  *review = it->review;
+  return true;
+}
+
+QStringList ReviewSchedule::next(int k, qint64 now) const {
+  QMutexLocker locker(&lock_);
+  QStringList ngrams;
+  vector<Due> taken;
+  // nothing below the top is due sooner, stale or not.
+  while (ngrams.size() < k && !heap_.empty() && heap_.front().due <= now) {
+    std::pop_heap(heap_.begin(), heap_.end(), later);
+    Due due = heap_.back();
+    heap_.pop_back();
+    auto it = scheduled_.constFind(due.id);
+    // stale entries are dropped for good.
+    if (it == scheduled_.constEnd() || it->version != due.version) continue;
+    taken.push_back(due);
+    ngrams << it->ngram;
+  }
+  for (const auto& due : taken) {
+    heap_.push_back(due);
+    std::push_heap(heap_.begin(), heap_.end(), later);
+  }
+  return ngrams;
+}
+
+void ReviewSchedule::set(const Entry& entry) {
+  auto it = scheduled_.find(entry.id);
+  if (it == scheduled_.end())
+    it = scheduled_.insert(entry.id, Scheduled{entry.ngram, entry.review, 0});
+  else
+    *it = Scheduled{entry.ngram, entry.review, it->version + 1};
+  heap_.push_back(Due{entry.review.due, entry.id, it->version});
+  std::push_heap(heap_.begin(), heap_.end(), later);
+}
+
+void ReviewSchedule::compact() {
+  if (heap_.size() <= 2 * static_cast<size_t>(scheduled_.size()) + 64) return;
+  heap_.clear();
+  for (auto it = scheduled_.constBegin(); it != scheduled_.constEnd(); ++it)
+    heap_.push_back(Due{it->review.due, it.key(), it->version});
+  std::make_heap(heap_.begin(), heap_.end(), later);
+}
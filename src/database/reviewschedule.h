@@ -0,0 +1,109 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_DATABASE_REVIEWSCHEDULE_H_
+#define SRC_DATABASE_REVIEWSCHEDULE_H_
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+#include <vector>
+
+using std::vector;
+
+//! When an ngram is due for practice again and how its reviews went.
+struct Review {
+  //! seconds since the epoch.
+  qint64 due = 0;
+  //! days until the next review once it's passed.
+  double interval = 0.0;
+  double ease = 2.5;
+  //! passed reviews in a row.
+  int reps = 0;
+  int lapses = 0;
+};
+
+/*! Spaced repetition of the weak words of a profile, scheduled like SM-2.
+
+  Words are graded from every test they're typed in and the ones due the
+  soonest are kept at the top of a heap, so picking the next few takes
+  O(k log n). Like RecentResults it's shared by every Database opened on the
+  profile, loaded from the review table the first time it's needed and kept
+  up to date as statistics are saved.
+*/
+class ReviewSchedule {
+ public:
+  //! reviews graded lower are lapses.
+  static constexpr const int kPass = 3;
+
+  struct Entry {
+    long long id;
+    QString ngram;
+    Review review;
+  };
+
+  /*! the grade from 0 to 5 of typing an ngram with `mistakes` at `wpm` in a
+    test typed at `test_wpm`. */
+  static int quality(int mistakes, double wpm, double test_wpm);
+  //! `review` after a review graded `quality` at `now`.
+  static Review grade(Review review, int quality, qint64 now);
+
+  //! replace the schedule with `entries`.
+  void load(const vector<Entry>& entries);
+  //! set the reviews of some ngrams, ignored until the schedule is loaded.
+  void update(const vector<Entry>& entries);
+  //! forget the schedule until it's loaded again.
+  void invalidate();
+  bool loaded() const;
+  //! the number of ngrams scheduled.
+  int size() const;
+  //! the review of ngram `id`, false if it isn't scheduled.
+  bool find(long long id, Review* review) const;
+  /*! up to `k` ngrams that are due at `now`, in seconds since the epoch, the
+    most overdue first. */
+  QStringList next(int k, qint64 now) const;
+
+ private:
+  struct Scheduled {
+    QString ngram;
+    Review review;
+    //! bumped when the review changes, older heap entries are stale.
+    int version;
+  };
+  struct Due {
+    qint64 due;
+    long long id;
+    int version;
+  };
+
+  //! orders the heap with the soonest due on top.
+  static bool later(const Due& a, const Due& b) { return a.due > b.due; }
+  void set(const Entry& entry);
+  //! drop the stale heap entries once they outnumber the scheduled ngrams.
+  void compact();
+
+  mutable QMutex lock_;
+  QHash<long long, Scheduled> scheduled_;
+  //! ordered by due time, soonest on top.
+  mutable vector<Due> heap_;
+  bool loaded_ = false;
+};
+
+#endif  // SRC_DATABASE_REVIEWSCHEDULE_H_
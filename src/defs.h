@@ -37,6 +37,8 @@ enum class SelectionMethod {
   Random = 0,
   InOrder,
   Repeat,
+  WeakSpots,
+  SpacedRepetition,
   SlowWords,
   FastWords,
   ViscousWords,
@@ -21,18 +21,24 @@
 #include <QApplication>
 #include <QCoreApplication>
 #include <QDirIterator>
+#include <QFileDialog>
 #include <QMessageBox>
+#include <QProgressDialog>
 #include <QSettings>
 #include <QSize>
 #include <QStandardPaths>
+#include <QThreadPool>
 
 #include <QsLog.h>
 
 #include "config.h"
 #include "database/db.h"
+#include "database/migrationcontroller.h"
 #include "mainwindow/liveplot/liveplot.h"
+#include "quizzer/replay.h"
 #include "texts/library.h"
 #include "texts/text.h"
+#include "texts/textprefetcher.h"
 #include "ui_mainwindow.h"
 
 using std::make_unique;
@@ -44,6 +50,9 @@ MainWindow::MainWindow(QWidget* parent)
   ui->menuTest->addAction(ui->quizzer->restartAction());
   ui->menuTest->addAction(ui->quizzer->cancelAction());
   ui->menuView->addAction(ui->mapDock->toggleViewAction());
+  ui->menuView->addSeparator();
+  ui->menuView->addAction(ui->quizzer->latencyOverlayAction());
+  ui->menuView->addAction(ui->quizzer->latencyDumpAction());
 
   // Actions
   connect(ui->actionQuit, &QAction::triggered, this, &QWidget::close);
@@ -98,6 +107,8 @@ MainWindow::MainWindow(QWidget* parent)
           &PerformanceHistory::refreshSources);
   connect(&library_, &Library::sourcesChanged, &performance_,
           &PerformanceHistory::refresh);
+  connect(&library_, &Library::sourcesChanged, ui->quizzer->prefetcher(),
+          &TextPrefetcher::invalidate);
   connect(&library_, &Library::sourcesDeleted, ui->quizzer,
           &Quizzer::checkSource);
   connect(&library_, &Library::textsDeleted, ui->quizzer, &Quizzer::checkText);
@@ -202,8 +213,22 @@ void MainWindow::populateProfiles() {
 
   auto a_create = ui->menuProfiles->addAction(tr("New profile"));
   auto a_compress = ui->menuProfiles->addAction(tr("Compress database"));
+  auto a_archive = ui->menuProfiles->addAction(tr("Archive old data"));
+  auto a_merge = ui->menuProfiles->addAction(tr("Merge profile..."));
+  auto a_replay = ui->menuProfiles->addAction(tr("Recompute statistics"));
   connect(a_create, &QAction::triggered, this, &MainWindow::createProfile);
+  connect(a_merge, &QAction::triggered, this, &MainWindow::mergeProfile);
+  connect(a_replay, &QAction::triggered, this, &MainWindow::replayProfile);
   connect(a_compress, &QAction::triggered, this, [this] { db_->compress(); });
+  connect(a_archive, &QAction::triggered, this, [this] {
+    QSettings s;
+    bool ok;
+    int days = s.value("archive_days", 0).toInt();
+    days = QInputDialog::getInt(this, tr("Archive old data"),
+                                tr("Archive data older than (days):"),
+                                days ? days : 365, 1, 3650, 1, &ok);
+    if (ok) archiveProfile(s.value("profile", "default").toString(), days);
+  });
 
   ui->menuProfiles->addSeparator();
 
@@ -238,10 +263,89 @@ void MainWindow::changeProfile(const QString& name) {
   QSettings s;
   s.setValue("profile", name);
   db_.reset(new Database(name));
-  db_->initDB();
+  if (!db_->initDB())
+    migrateProfile(name);
+  else if (s.value("archive_days", 0).toInt() > 0)
+    archiveProfile(name, s.value("archive_days").toInt());
   emit profileChanged(name);
 }
 
+void MainWindow::migrateProfile(const QString& name) {
+  QLOG_INFO() << "migrating profile" << name << "in the background";
+  // everything opened until the migration is done can only read.
+  Database::setReadOnly(true);
+  db_.reset(new Database(name));
+  ui->menuProfiles->setEnabled(false);
+
+  auto mc = new MigrationController(name);
+  auto progress = new QProgressDialog(tr("Upgrading profile..."), QString(),
+                                      0, 100, this);
+  progress->setWindowModality(Qt::NonModal);
+  progress->setMinimumDuration(0);
+  progress->setAutoClose(false);
+
+  connect(mc, &MigrationController::progressUpdate, progress,
+          &QProgressDialog::setValue);
+  connect(mc, &MigrationController::done, this, [this, name](bool ok) {
+    if (!ok) QLOG_ERROR() << "migrating profile" << name << "failed";
+    Database::setReadOnly(false);
+    db_.reset(new Database(name));
+    ui->menuProfiles->setEnabled(true);
+    // reopen everything with a writable connection to the new schema.
+    emit profileChanged(name);
+    QSettings s;
+    if (ok && s.value("archive_days", 0).toInt() > 0)
+      archiveProfile(name, s.value("archive_days").toInt());
+  });
+  connect(mc, &MigrationController::done, mc,
+          &MigrationController::deleteLater);
+  connect(mc, &MigrationController::done, progress,
+          &QProgressDialog::deleteLater);
+
+  mc->start();
+}
+
+void MainWindow::archiveProfile(const QString& name, int days) {
+  QLOG_INFO() << "archiving data of" << name << "older than" << days << "days";
+  runProfileTask(name, [days](Database* db) { db->archive(days); });
+}
+
+void MainWindow::mergeProfile() {
+  auto file = QFileDialog::getOpenFileName(
+      this, tr("Merge profile"),
+      QStandardPaths::writableLocation(QStandardPaths::AppDataLocation),
+      tr("amphetype2 profiles (*.profile)"));
+  if (file.isEmpty()) return;
+  QSettings s;
+  runProfileTask(s.value("profile", "default").toString(),
+                 [file](Database* db) { db->mergeProfile(file); });
+}
+
+void MainWindow::replayProfile() {
+  auto answer = QMessageBox::question(
+      this, tr("Recompute statistics"),
+      tr("Replace the statistics of every result that has recorded "
+         "keystrokes with ones computed again from those keystrokes?"));
+  if (answer != QMessageBox::Yes) return;
+  QSettings s;
+  runProfileTask(s.value("profile", "default").toString(),
+                 [](Database* db) { replay::replayProfile(db); });
+}
+
+void MainWindow::runProfileTask(
+    const QString& name, const std::function<void(Database*)>& work) {
+  auto task = new ProfileTask(name, work);
+  connect(task, &ProfileTask::done, this, [this, name] {
+    QSettings s;
+    if (s.value("profile").toString() != name) return;
+    // reopen everything, connections opened before an archive existed don't
+    // see it yet.
+    db_.reset(new Database(name));
+    emit profileChanged(name);
+  });
+  QThreadPool::globalInstance()->start(task);
+}
+
 void MainWindow::closeEvent(QCloseEvent* event) {
   saveSettings();
   qApp->quit();
@@ -253,3 +357,13 @@ void MainWindow::aboutDialog() {
                          .arg(amphetype2_VERSION_STRING_FULL)
                          .arg(QT_VERSION_STR));
 }
+
+ProfileTask::ProfileTask(const QString& profile,
+                         const std::function<void(Database*)>& work)
+    : profile_(profile), work_(work) {}
+
+void ProfileTask::run() {
+  Database db(profile_);
+  work_(&db);
+  emit done();
+}
@@ -22,8 +22,10 @@
 #include <QCloseEvent>
 #include <QEvent>
 #include <QMainWindow>
+#include <QRunnable>
 #include <QString>
 
+#include <functional>
 #include <memory>
 
 #include "analysis/statisticswidget.h"
@@ -59,6 +61,10 @@ class MainWindow : public QMainWindow, public AmphetypeWindow {
   void onProfileChange() override;
   void createProfile();
   void changeProfile(const QString& = QString());
+  void migrateProfile(const QString&);
+  void archiveProfile(const QString&, int days);
+  void mergeProfile();
+  void replayProfile();
   void updateWindowTitle();
   void aboutDialog();
   void populateProfiles();
@@ -67,6 +73,10 @@ class MainWindow : public QMainWindow, public AmphetypeWindow {
   void closeEvent(QCloseEvent* event) override;
 
  private:
+  //! run `work` on the profile on a worker thread, then reload the profile.
+  void runProfileTask(const QString& name,
+                      const std::function<void(Database*)>& work);
+
   unique_ptr<Ui::MainWindow> ui;
   unique_ptr<Database> db_;
   SettingsWidget settings_;
@@ -77,4 +87,21 @@ class MainWindow : public QMainWindow, public AmphetypeWindow {
   TrainingGenWidget training_generator_;
 };
 
+//! Runs some work on a profile's database on a worker thread.
+class ProfileTask : public QObject, public QRunnable {
+  Q_OBJECT
+
+ public:
+  ProfileTask(const QString& profile,
+              const std::function<void(Database*)>& work);
+  void run() override;
+
+ signals:
+  void done();
+
+ private:
+  QString profile_;
+  std::function<void(Database*)> work_;
+};
+
 #endif  // SRC_MAINWINDOW_MAINWINDOW_H_
@@ -23,6 +23,7 @@
 #include <QDateTime>
 #include <QMenu>
 #include <QSettings>
+#include <QStringList>
 #include <QStandardItemModel>
 
 #include <algorithm>
@@ -348,22 +349,38 @@ void PerformanceHistory::refreshData() {
   ui->avgACC->setText(QString::number(acc_sum / model_.rowCount(), 'f', 1));
   ui->avgVIS->setText(QString::number(vis_sum / model_.rowCount(), 'f', 1));
 
-  auto range = db_->resultsWpmRange();
-  if (range.size() >= 2) {
-    auto worst = range.begin();
-    auto best = ++range.begin();
-    ui->bestLabel->setText(
-        QString("Worst: <b>%1</b> wpm on %2 (%3)<br/>"
-                "Best: <b>%4</b> wpm on %5 (%6)")
-            .arg(worst->second)
-            .arg(worst->first.toString("MMM d, yyyy"))
-            .arg(util::date::PrettyTimeDelta(worst->first, now))
-            .arg(best->second)
-            .arg(best->first.toString("MMM d, yyyy"))
-            .arg(util::date::PrettyTimeDelta(best->first, now)));
-  } else {
-    ui->bestLabel->clear();
+  QStringList summary;
+  ResultRanks::Extreme worst, best;
+  if (db_->resultRanks()->wpmRange(&worst, &best)) {
+    summary << QString("Worst: <b>%1</b> wpm on %2 (%3)")
+                   .arg(worst.wpm)
+                   .arg(worst.when.toString("MMM d, yyyy"))
+                   .arg(util::date::PrettyTimeDelta(worst.when, now))
+            << QString("Best: <b>%1</b> wpm on %2 (%3)")
+                   .arg(best.wpm)
+                   .arg(best.when.toString("MMM d, yyyy"))
+                   .arg(util::date::PrettyTimeDelta(best.when, now));
   }
+  // rolling medians of the windows that are full, and the first one that
+  // isn't.
+  auto recent = db_->recentResults();
+  for (int size : recent->sizes()) {
+    int count = recent->count(size);
+    if (!count) break;
+    summary << QString("Last %1: median <b>%2</b> wpm (%3%), "
+                       "90th percentile <b>%4</b> wpm")
+                   .arg(count)
+                   .arg(recent->median(RecentResults::Wpm, size), 0, 'f', 1)
+                   .arg(recent->median(RecentResults::Accuracy, size), 0,
+                        'f', 1)
+                   .arg(recent->percentile(RecentResults::Wpm, size, 0.9),
+                        0, 'f', 1);
+    if (count < size) break;
+  }
+  if (summary.isEmpty())
+    ui->bestLabel->clear();
+  else
+    ui->bestLabel->setText(summary.join("<br/>"));
 
   refreshCurrentPlot();
 }
@@ -0,0 +1,232 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "quizzer/keystrokelog.h"
+
+#include <algorithm>
+
+namespace {
+
+// the first byte of a log, bumped if the encoding ever changes. version 1
+// logs have no releases, version 2 logs have them between the keystrokes
+// and version 3 logs have no flags.
+static constexpr const char kVersion = 4;
+
+quint64 zigzag(qint64 v) {
+  return (static_cast<quint64>(v) << 1) ^ static_cast<quint64>(v >> 63);
+}
+
+qint64 unzigzag(quint64 v) {
+  return static_cast<qint64>(v >> 1) ^ -static_cast<qint64>(v & 1);
+}
+
+void appendVarint(QByteArray* data, quint64 value) {
+  while (value >= 0x80) {
+    data->append(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  data->append(static_cast<char>(value));
+}
+
+bool readVarint(const QByteArray& data, int end, int* pos, quint64* value) {
+  *value = 0;
+  for (int shift = 0; *pos < end && shift < 64; shift += 7) {
+    auto byte = static_cast<quint8>(data[(*pos)++]);
+    *value |= static_cast<quint64>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+KeystrokeLog::KeystrokeLog(const QString& text, int flags)
+    : text_(text), flags_(flags) {
+  // most keys take a byte or two, so typing rarely has to grow it.
+  presses_.reserve(2 * text.length() + 16);
+  dwells_.reserve(text.length() + 16);
+}
+
+void KeystrokeLog::insert(qint64 ns, QChar c) {
+  bool correct = length_ < text_.length() && text_[length_] == c;
+  append(ns, correct ? Event::Type::Correct : Event::Type::Mistake);
+  if (!correct) appendVarint(&presses_, c.unicode());
+  ++length_;
+}
+
+void KeystrokeLog::erase(qint64 ns) {
+  if (!length_) return;
+  append(ns, Event::Type::Erase);
+  --length_;
+}
+
+void KeystrokeLog::release(int back, qint64 dwell_ns) {
+  if (back < 0 || back >= size_) return;
+  dwells_[size_ - 1 - back] =
+      std::max<qint64>(0, (dwell_ns + 500000) / 1000000);
+}
+
+QByteArray KeystrokeLog::data() const {
+  QByteArray data;
+  data.reserve(presses_.size() + dwells_.size() + 8);
+  data.append(kVersion);
+  appendVarint(&data, flags_);
+  appendVarint(&data, presses_.size());
+  data.append(presses_);
+  // keystrokes at the end that weren't released are left out.
+  auto end = dwells_.size();
+  while (end && dwells_[end - 1] < 0) --end;
+  qint64 last = 0;
+  for (size_t i = 0; i < end; ++i) {
+    if (dwells_[i] < 0) {
+      data.append('\0');
+      continue;
+    }
+    appendVarint(&data, zigzag(dwells_[i] - last) + 1);
+    last = dwells_[i];
+  }
+  return data;
+}
+
+QByteArray KeystrokeLog::take() {
+  auto data = this->data();
+  presses_.clear();
+  dwells_.clear();
+  size_ = length_ = 0;
+  last_ms_ = last_interval_ = 0;
+  return data;
+}
+
+void KeystrokeLog::append(qint64 ns, Event::Type type) {
+  qint64 ms = (ns + 500000) / 1000000;
+  qint64 interval = ms - last_ms_;
+  appendVarint(&presses_, zigzag(interval - last_interval_) << 2 |
+                              static_cast<quint8>(type));
+  last_ms_ = ms;
+  last_interval_ = interval;
+  dwells_.push_back(-1);
+  ++size_;
+}
+
+std::vector<KeystrokeLog::Event> KeystrokeLog::decode(const QByteArray& data,
+                                                      const QString& text) {
+  std::vector<Event> events;
+  if (data.isEmpty() || data[0] < 1 || data[0] > kVersion) return events;
+  bool inline_releases = data[0] < 3;
+
+  int pos = 1;
+  int end = data.size();
+  quint64 value;
+  if (data[0] >= 4 && !readVarint(data, end, &pos, &value)) return events;
+  if (!inline_releases) {
+    if (!readVarint(data, end, &pos, &value) ||
+        value > static_cast<quint64>(end - pos))
+      return events;
+    end = pos + static_cast<int>(value);
+  }
+
+  // the index of each keystroke in events, releases refer back to them.
+  std::vector<int> presses;
+  int length = 0;
+  qint64 ms = 0;
+  qint64 interval = 0;
+  while (readVarint(data, end, &pos, &value)) {
+    Event event;
+    event.type = static_cast<Event::Type>(value & 3);
+    event.press = -1;
+    if (event.type == Event::Type::Release) {
+      quint64 back = value >> 2;
+      if (!inline_releases || back >= presses.size() ||
+          !readVarint(data, end, &pos, &value))
+        return events;
+      event.press = presses[presses.size() - 1 - back];
+      event.character = events[event.press].character;
+      event.position = events[event.press].position;
+      event.ms = events[event.press].ms + static_cast<qint64>(value);
+      events.push_back(event);
+      continue;
+    }
+    interval += unzigzag(value >> 2);
+    ms += interval;
+    event.ms = ms;
+    switch (event.type) {
+      case Event::Type::Correct:
+        if (length >= text.length()) return events;
+        event.character = text[length];
+        event.position = length++;
+        break;
+      case Event::Type::Mistake:
+        if (!readVarint(data, end, &pos, &value)) return events;
+        event.character = QChar(static_cast<ushort>(value));
+        event.position = length++;
+        break;
+      case Event::Type::Erase:
+        if (!length) return events;
+        event.position = --length;
+        break;
+      default:
+        return events;
+    }
+    presses.push_back(static_cast<int>(events.size()));
+    events.push_back(event);
+  }
+  if (inline_releases) return events;
+
+  // the releases, put back between the keystrokes by time.
+  std::vector<Event> releases;
+  qint64 dwell = 0;
+  for (size_t i = 0; i < presses.size() &&
+                     readVarint(data, data.size(), &pos, &value);
+       ++i) {
+    if (!value) continue;
+    dwell += unzigzag(value - 1);
+    Event release = events[i];
+    release.type = Event::Type::Release;
+    release.ms += dwell;
+    release.press = static_cast<int>(i);
+    releases.push_back(release);
+  }
+  std::stable_sort(releases.begin(), releases.end(),
+                   [](const Event& a, const Event& b) { return a.ms < b.ms; });
+  std::vector<Event> merged;
+  merged.reserve(events.size() + releases.size());
+  auto release = releases.begin();
+  for (size_t i = 0; i < events.size(); ++i) {
+    for (; release != releases.end() && release->ms <= events[i].ms &&
+           release->press < static_cast<int>(i);
+         ++release) {
+      merged.push_back(*release);
+      merged.back().press = presses[release->press];
+    }
+    presses[i] = static_cast<int>(merged.size());
+    merged.push_back(events[i]);
+  }
+  for (; release != releases.end(); ++release) {
+    merged.push_back(*release);
+    merged.back().press = presses[release->press];
+  }
+  return merged;
+}
+
+int KeystrokeLog::flags(const QByteArray& data) {
+  if (data.size() < 2 || data[0] < 4 || data[0] > kVersion) return -1;
+  int pos = 1;
+  quint64 value;
+  if (!readVarint(data, data.size(), &pos, &value)) return -1;
+  return static_cast<int>(value);
+}
@@ -0,0 +1,107 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_QUIZZER_KEYSTROKELOG_H_
+#define SRC_QUIZZER_KEYSTROKELOG_H_
+
+#include <QByteArray>
+#include <QChar>
+#include <QString>
+
+#include <vector>
+
+/*! Every keystroke of a test, encoded compactly enough to keep with each
+  result.
+
+  The input is only ever changed at its end, so positions aren't stored, and
+  a correct character is the one in the text so only mistyped characters are.
+  A keystroke is one varint: the change in the time since the previous
+  keystroke, zigzag encoded, shifted left by two with the type in the low
+  bits. Mistakes are followed by a varint of the typed UTF-16 code. Times are
+  in ms since the start of the test. A keystroke only fits in one byte when
+  its interval is within 16 ms of the previous one, anything up to two
+  seconds takes two. Real typing varies by tens of ms, so it's nearer two
+  bytes a keystroke, about 1.8 for intervals spread by 40 ms.
+
+  Key releases are kept in a second stream after the keystrokes, the length
+  of the keystrokes is a varint before them. It has a varint for every
+  keystroke in order: 0 when its key wasn't released, otherwise one more
+  than the change in how long a key was held since the previous release,
+  zigzag encoded. Holds vary less than intervals, so that's about a byte a
+  keystroke, and the keystrokes alone stay under two.
+
+  The version is followed by a varint of the Flags the test was typed with,
+  so that it can be typed again the same way.
+*/
+class KeystrokeLog {
+ public:
+  struct Event {
+    enum class Type : quint8 { Correct, Mistake, Erase, Release };
+    Type type;
+    QChar character;
+    //! the position typed at, or of the erased character. for a release,
+    //! those of the keystroke it released.
+    int position;
+    qint64 ms;
+    //! for a release, the index of the keystroke it released.
+    int press;
+  };
+
+  //! how the test was typed.
+  enum Flags : quint8 {
+    //! the test waited for a space before it started.
+    RequireSpace = 1
+  };
+
+  explicit KeystrokeLog(const QString& text, int flags = 0);
+  //! \param ns the time since the start of the test.
+  void insert(qint64 ns, QChar c);
+  //! erase the last character of the input. \param ns as for insert.
+  void erase(qint64 ns);
+  /*! the key of a keystroke was released.
+    \param back how many keystrokes were logged after it.
+    \param dwell_ns how long it was held. */
+  void release(int back, qint64 dwell_ns);
+  //! the number of keystrokes logged.
+  int size() const { return size_; }
+  //! the bytes taken by the keystrokes, without their releases.
+  int pressBytes() const { return presses_.size(); }
+  QByteArray data() const;
+  QByteArray take();
+
+  //! the keystrokes in `data`, which was logged while typing `text`.
+  static std::vector<Event> decode(const QByteArray& data,
+                                   const QString& text);
+  //! the Flags of `data`, -1 if it's from before they were logged.
+  static int flags(const QByteArray& data);
+
+ private:
+  void append(qint64 ns, Event::Type type);
+
+  QString text_;
+  int flags_;
+  QByteArray presses_;
+  //! how long the key of each keystroke was held in ms, -1 if not released.
+  std::vector<qint64> dwells_;
+  int size_ = 0;
+  int length_ = 0;
+  qint64 last_ms_ = 0;
+  qint64 last_interval_ = 0;
+};
+
+#endif  // SRC_QUIZZER_KEYSTROKELOG_H_
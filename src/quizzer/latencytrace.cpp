@@ -0,0 +1,130 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "quizzer/latencytrace.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QTextStream>
+#include <QtAlgorithms>
+
+#include <algorithm>
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram() { reset(); }
+
+void LatencyHistogram::record(qint64 ns) {
+  ns = std::max<qint64>(ns, 0);
+  buckets_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  qint64 max = max_.load(std::memory_order_relaxed);
+  while (ns > max &&
+         !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::reset() {
+  for (auto& bucket : buckets_) bucket.store(0, std::memory_order_relaxed);
+  count_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+qint64 LatencyHistogram::percentile(double fraction) const {
+  quint64 total = count();
+  if (!total) return 0;
+  auto rank = static_cast<quint64>(std::ceil(fraction * total));
+  rank = std::max<quint64>(rank, 1);
+  quint64 seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) return std::min(upperBound(i), max());
+  }
+  return max();
+}
+
+int LatencyHistogram::bucket(qint64 ns) {
+  if (ns < kSubBuckets) return static_cast<int>(ns);
+  // the highest set bit picks the power of two, the three below it the
+  // sub bucket.
+  int exponent = 63 - qCountLeadingZeroBits(static_cast<quint64>(ns));
+  int sub = (ns >> (exponent - 3)) & (kSubBuckets - 1);
+  return std::min((exponent - 2) * kSubBuckets + sub, kBuckets - 1);
+}
+
+qint64 LatencyHistogram::upperBound(int bucket) {
+  if (bucket < kSubBuckets) return bucket;
+  int exponent = bucket / kSubBuckets + 2;
+  qint64 lower = static_cast<qint64>(kSubBuckets + bucket % kSubBuckets)
+                 << (exponent - 3);
+  return lower + (static_cast<qint64>(1) << (exponent - 3)) - 1;
+}
+
+void LatencyTrace::reset() {
+  for (auto& stage : stages_) stage.reset();
+}
+
+QString LatencyTrace::stageName(Stage stage) {
+  switch (stage) {
+    case Queue:
+      return "queue";
+    case Process:
+      return "test";
+    case Poll:
+      return "poll";
+    case Render:
+      return "render";
+    case Plot:
+      return "plot";
+    case Paint:
+      return "paint";
+    case KeyToCursor:
+      return "key to cursor";
+    default:
+      return QString();
+  }
+}
+
+QString LatencyTrace::report() const {
+  auto us = [](qint64 ns) { return QString::number(ns / 1000.0, 'f', 1); };
+  QString report = QString("%1 %2 %3 %4 %5\n")
+                       .arg("stage", -13)
+                       .arg("count", 8)
+                       .arg("p50 us", 9)
+                       .arg("p99 us", 9)
+                       .arg("max us", 9);
+  for (int i = 0; i < StageCount; ++i) {
+    const auto& h = stages_[i];
+    report += QString("%1 %2 %3 %4 %5\n")
+                  .arg(stageName(static_cast<Stage>(i)), -13)
+                  .arg(h.count(), 8)
+                  .arg(us(h.percentile(0.5)), 9)
+                  .arg(us(h.percentile(0.99)), 9)
+                  .arg(us(h.max()), 9);
+  }
+  return report;
+}
+
+bool LatencyTrace::dump(const QString& path) const {
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+  QTextStream out(&file);
+  out << "keystroke latency at "
+      << QDateTime::currentDateTime().toString(Qt::ISODate) << "\n"
+      << report();
+  return true;
+}
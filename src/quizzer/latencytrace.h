@@ -0,0 +1,90 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_QUIZZER_LATENCYTRACE_H_
+#define SRC_QUIZZER_LATENCYTRACE_H_
+
+#include <QString>
+#include <QtGlobal>
+
+#include <array>
+#include <atomic>
+
+/*! A histogram of latencies in ns. Buckets are powers of two split in eight,
+  so percentiles are within 12.5%. Recording is a few relaxed atomic
+  operations and can be done from any thread. */
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+  void record(qint64 ns);
+  void reset();
+  quint64 count() const { return count_.load(std::memory_order_relaxed); }
+  qint64 max() const { return max_.load(std::memory_order_relaxed); }
+  //! the latency `fraction` of the samples are at or below, 0 if empty.
+  qint64 percentile(double fraction) const;
+
+ private:
+  static constexpr const int kSubBuckets = 8;
+  static constexpr const int kBuckets = 62 * kSubBuckets;
+  static int bucket(qint64 ns);
+  //! the largest latency that falls into `bucket`.
+  static qint64 upperBound(int bucket);
+
+  std::array<std::atomic<quint64>, kBuckets> buckets_;
+  std::atomic<quint64> count_;
+  std::atomic<qint64> max_;
+};
+
+/*! Latencies of the stages a keystroke goes through, from the key event to
+  the typer display. Cheap enough to always be on. */
+class LatencyTrace {
+ public:
+  enum Stage {
+    //! key event to the test thread picking the key up.
+    Queue,
+    //! Test handling the key.
+    Process,
+    //! the test's display update waiting for the GUI thread.
+    Poll,
+    //! TyperDisplay::moveCursor re-rendering the text.
+    Render,
+    //! the live plot handling a new wpm.
+    Plot,
+    //! TyperDisplay painting.
+    Paint,
+    //! key event to the cursor having moved.
+    KeyToCursor,
+    StageCount
+  };
+
+  void record(Stage stage, qint64 ns) { stages_[stage].record(ns); }
+  const LatencyHistogram& histogram(Stage stage) const {
+    return stages_[stage];
+  }
+  void reset();
+  static QString stageName(Stage stage);
+  //! a table of the count, p50, p99 and max of every stage.
+  QString report() const;
+  //! write the report to `path`, returns false if it can't be written.
+  bool dump(const QString& path) const;
+
+ private:
+  std::array<LatencyHistogram, StageCount> stages_;
+};
+
+#endif  // SRC_QUIZZER_LATENCYTRACE_H_
@@ -25,10 +25,12 @@
 #include <QMetaType>
 #include <QPainter>
 #include <QSettings>
+#include <QStandardPaths>
 #include <QThreadPool>
 #include <QUrl>
 
 #include <algorithm>
+#include <cmath>
 
 #include <QsLog.h>
 
@@ -43,14 +45,16 @@ Quizzer::Quizzer(QWidget* parent)
     : QWidget(parent),
       ui(make_unique<Ui::Quizzer>()),
       action_restart_(tr("Restart")),
-      action_cancel_(tr("Cancel")) {
+      action_cancel_(tr("Cancel")),
+      action_latency_overlay_(tr("Latency overlay")),
+      action_latency_dump_(tr("Dump latency trace")) {
   ui->setupUi(this);
   qRegisterMetaType<shared_ptr<TestResult>>();
+  qRegisterMetaType<Keystroke>();
   
   loadSettings();
 
   setFocusPolicy(Qt::StrongFocus);
-  text_edit_.setTextInteractionFlags(Qt::TextEditable);
   lesson_timer_.setInterval(1000);
 
   action_cancel_.setShortcuts(
@@ -83,18 +87,50 @@ Quizzer::Quizzer(QWidget* parent)
   });
 
   connect(this, &Quizzer::colorChanged, this, &Quizzer::timerLabelStop);
+  connect(this, &Quizzer::newStatistics, &prefetcher_,
+          &TextPrefetcher::invalidateStatistics);
   connect(&lesson_timer_, &QTimer::timeout, this, &Quizzer::timerLabelUpdate);
 
-  test_thread_.start();
+  // display updates of the test are picked up as soon as the first of them
+  // is queued.
+  connect(&runner_, &TestRunner::updatesReady, this,
+          &Quizzer::showDisplayUpdates, Qt::QueuedConnection);
+
+  // keystroke latencies, shown over the typer display when asked for.
+  ui->typerDisplay->setLatencyTrace(&runner_.trace());
+  latency_overlay_ = new QLabel(this);
+  latency_overlay_->setAttribute(Qt::WA_TransparentForMouseEvents);
+  latency_overlay_->setFont(
+      QFontDatabase::systemFont(QFontDatabase::FixedFont));
+  latency_overlay_->setStyleSheet(
+      "QLabel { background-color: rgba(0, 0, 0, 160); color: white; "
+      "padding: 4px; }");
+  latency_overlay_->hide();
+  latency_timer_.setInterval(500);
+  connect(&latency_timer_, &QTimer::timeout, this,
+          &Quizzer::updateLatencyOverlay);
+  action_latency_overlay_.setCheckable(true);
+  action_latency_overlay_.setShortcut(QKeySequence(tr("Ctrl+Shift+L")));
+  connect(&action_latency_overlay_, &QAction::toggled, this,
+          &Quizzer::showLatencyOverlay);
+  connect(&action_latency_dump_, &QAction::triggered, this,
+          &Quizzer::dumpLatencyTrace);
+
+  runner_.start();
 }
 
-Quizzer::~Quizzer() {
-  test_thread_.quit();
-  test_thread_.wait();
-}
+Quizzer::~Quizzer() {}
 
 void Quizzer::onProfileChange() {
   db_.reset(new Database);
+  // the profile can't change while it's upgraded, so the results kept until
+  // the upgrade is done belong to this one.
+  if (!Database::readOnly()) {
+    for (const auto& result : unsaved_) saveResult(result);
+    unsaved_.clear();
+  }
+  QThreadPool::globalInstance()->start(new RanksLoader);
+  prefetcher_.invalidate();
   setPreviousResultText(0, 0);
   timerLabelReset();
   loadNewText();
@@ -102,26 +138,29 @@ void Quizzer::onProfileChange() {
 
 QAction* Quizzer::restartAction() { return &action_restart_; }
 QAction* Quizzer::cancelAction() { return &action_cancel_; }
+QAction* Quizzer::latencyOverlayAction() { return &action_latency_overlay_; }
+QAction* Quizzer::latencyDumpAction() { return &action_latency_dump_; }
+TextPrefetcher* Quizzer::prefetcher() { return &prefetcher_; }
 
 void Quizzer::loadNewText() {
   QSettings s;
-  setText(Text::selectText(static_cast<amphetype::SelectionMethod>(
+  setText(prefetcher_.next(static_cast<amphetype::SelectionMethod>(
       s.value("select_method", 0).toInt())));
 }
 void Quizzer::actionGrindWords() {
-  setText(Text::selectText(amphetype::SelectionMethod::SlowWords));
+  setText(prefetcher_.next(amphetype::SelectionMethod::SlowWords));
 }
 
 void Quizzer::actionGrindViscWords() {
-  setText(Text::selectText(amphetype::SelectionMethod::ViscousWords));
+  setText(prefetcher_.next(amphetype::SelectionMethod::ViscousWords));
 }
 
 void Quizzer::actionGrindInaccurateWords() {
-  setText(Text::selectText(amphetype::SelectionMethod::InaccurateWords));
+  setText(prefetcher_.next(amphetype::SelectionMethod::InaccurateWords));
 }
 
 void Quizzer::actionGrindDamagingWords() {
-  setText(Text::selectText(amphetype::SelectionMethod::DamagingWords));
+  setText(prefetcher_.next(amphetype::SelectionMethod::DamagingWords));
 }
 
 void Quizzer::loadSettings() {
@@ -152,6 +191,11 @@ void Quizzer::loadSettings() {
   ui->typerDisplay->setCols(ui->typerColsSpinBox->value());
   ui->typerDisplay->setFont(f);
   ui->typerDisplay->updateDisplay();
+  // the selection method may have changed.
+  if (test_) {
+    prefetcher_.prefetch(test_->text()->nextTextSelectionPreference(),
+                         test_->text());
+  }
 }
 
 void Quizzer::saveSettings() {
@@ -164,12 +208,14 @@ void Quizzer::saveSettings() {
 }
 
 void Quizzer::checkSource(const QList<int>& sources) {
+  prefetcher_.invalidate();
   auto s = std::find(sources.begin(), sources.end(), test_->text()->source());
   if (s != sources.end())
     setText(Text::selectText(amphetype::SelectionMethod::Random));
 }
 
 void Quizzer::checkText(const QList<int>& texts) {
+  prefetcher_.invalidate();
   auto s = std::find(texts.begin(), texts.end(), test_->text()->id());
   if (s != texts.end())
     setText(Text::selectText(amphetype::SelectionMethod::Random));
@@ -181,6 +227,7 @@ void Quizzer::alertText(const QString& text) {
 }
 
 void Quizzer::beginTest(int length) {
+  runner_.resetStats();
   lesson_timer_.start();
   timerLabelReset();
   timerLabelGo();
@@ -220,20 +267,18 @@ void Quizzer::setPreviousResultText(double lastWpm, double lastAcc) {
 
 void Quizzer::setText(shared_ptr<Text> t) {
   ui->typerDisplay->setTextTarget(t->text());
-  test_.reset(new Test(t, ui->spaceCheckBox->checkState() == Qt::Checked));
-  test_->moveToThread(&test_thread_);
-  connect(this, &Quizzer::newInput, test_.get(), &Test::handleInput);
-  connect(test_.get(), &Test::mistake, &error_sound_, &QSoundEffect::play);
-  connect(test_.get(), &Test::newWpm, this, &Quizzer::newWpm);
-  connect(test_.get(), &Test::testStarted, this, &Quizzer::testStarted);
-  connect(test_.get(), &Test::testStarted, this, &Quizzer::beginTest);
-  connect(test_.get(), &Test::startKeyReceived, &text_edit_,
-          &QPlainTextEdit::clear);
-  connect(test_.get(), &Test::positionChanged, ui->typerDisplay,
-          &TyperDisplay::moveCursor);
-  connect(test_.get(), &Test::resultReady, this, &Quizzer::handleResult);
-
-  text_edit_.clear();
+  auto test =
+      make_unique<Test>(t, ui->spaceCheckBox->checkState() == Qt::Checked);
+  test->moveToThread(&runner_);
+  connect(test.get(), &Test::testStarted, this, &Quizzer::testStarted);
+  connect(test.get(), &Test::testStarted, this, &Quizzer::beginTest);
+  connect(test.get(), &Test::resultReady, this, &Quizzer::handleResult);
+  // the old test is deleted once the runner doesn't use it anymore.
+  runner_.setTest(test.get());
+  test_ = std::move(test);
+
+  input_.clear();
+  waiting_for_space_ = ui->spaceCheckBox->checkState() == Qt::Checked;
 
   timerLabelStop();
   lesson_timer_.stop();
@@ -250,28 +295,159 @@ void Quizzer::toggleSounds(int state) {
 }
 
 void Quizzer::keyPressEvent(QKeyEvent* event) {
+  // timestamp the key before anything else so queueing and processing delays
+  // don't end up in the measured typing speed.
+  qint64 ns = Test::now();
   if (event->matches(QKeySequence::Copy) || event->matches(QKeySequence::Cut) ||
       event->matches(QKeySequence::Paste)) {
     event->ignore();
     return;
   }
-  int pos1 = text_edit_.textCursor().position();
-  QApplication::sendEvent(&text_edit_, event);
-  int pos2 = text_edit_.textCursor().position();
-  if (pos1 != pos2) emit newInput(text_edit_.toPlainText());
+
+  // repeats of a held key are typed, but only the first press is released.
+  int key = event->isAutoRepeat() ? 0 : event->key();
+  if (event->matches(QKeySequence::DeleteStartOfWord)) {
+    int start = input_.length();
+    while (start > 0 && input_[start - 1].isSpace()) --start;
+    while (start > 0 && !input_[start - 1].isSpace()) --start;
+    while (input_.length() > start) eraseKey(ns);
+  } else if (event->key() == Qt::Key_Backspace) {
+    eraseKey(ns, key);
+  } else if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter) {
+    insertKey('\n', ns, key);
+  } else {
+    for (QChar c : event->text()) {
+      if (!c.isPrint() && c != '\t') continue;
+      insertKey(c, ns, key);
+      // a key that typed several characters is only timed for the first.
+      key = 0;
+    }
+  }
+}
+
+void Quizzer::keyReleaseEvent(QKeyEvent* event) {
+  qint64 ns = Test::now();
+  if (event->isAutoRepeat() || !event->key()) return;
+  postKey(Keystroke{Keystroke::Type::Release, QChar(), input_.length(), ns,
+                    event->key()});
+}
+
+bool Quizzer::postKey(const Keystroke& key) {
+  if (runner_.post(key)) return true;
+  // the test missed a key, its result wouldn't be of what was typed.
+  QLOG_WARN() << "Quizzer: keystroke queue full, restarting the test";
+  alertText("Keys Dropped, Text Restarted");
+  setText(test_->text());
+  return false;
+}
+
+void Quizzer::insertKey(QChar c, qint64 ns, int key) {
+  if (!postKey(
+          Keystroke{Keystroke::Type::Insert, c, input_.length(), ns, key}))
+    return;
+  if (waiting_for_space_) {
+    waiting_for_space_ = c != ' ';
+    return;
+  }
+  input_.append(c);
+}
+
+void Quizzer::eraseKey(qint64 ns, int key) {
+  if (input_.isEmpty()) return;
+  input_.chop(1);
+  postKey(Keystroke{Keystroke::Type::Erase, QChar(), input_.length(), ns, key});
+}
+
+void Quizzer::showDisplayUpdates() {
+  auto& trace = runner_.trace();
+  DisplayUpdate update;
+  while (runner_.takeUpdate(&update)) {
+    const auto& v = update.values;
+    qint64 start = Test::now();
+    trace.record(LatencyTrace::Poll, start - update.posted_ns);
+    switch (update.type) {
+      case DisplayUpdate::Type::Position: {
+        ui->typerDisplay->moveCursor(v[0], v[1]);
+        qint64 end = Test::now();
+        trace.record(LatencyTrace::Render, end - start);
+        if (update.key_ns >= 0)
+          trace.record(LatencyTrace::KeyToCursor, end - update.key_ns);
+        break;
+      }
+      case DisplayUpdate::Type::Wpm:
+        emit newWpm(QPoint(v[0], v[1]), QPoint(v[2], v[3]));
+        trace.record(LatencyTrace::Plot, Test::now() - start);
+        break;
+      case DisplayUpdate::Type::Mistake:
+        error_sound_.play();
+        break;
+    }
+  }
+}
+
+void Quizzer::showLatencyOverlay(bool show) {
+  latency_overlay_->setVisible(show);
+  if (show) {
+    updateLatencyOverlay();
+    latency_timer_.start();
+  } else {
+    latency_timer_.stop();
+  }
+}
+
+void Quizzer::updateLatencyOverlay() {
+  latency_overlay_->setText(runner_.trace().report().trimmed());
+  latency_overlay_->adjustSize();
+  latency_overlay_->move(ui->typerDisplay->geometry().topLeft() +
+                         QPoint(8, 8));
+  latency_overlay_->raise();
+}
+
+void Quizzer::dumpLatencyTrace() {
+  auto path =
+      QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
+      "/latency.txt";
+  if (runner_.trace().dump(path))
+    QLOG_INFO() << "keystroke latency written to" << path;
+  else
+    QLOG_ERROR() << "can't write keystroke latency to" << path;
 }
 
 void Quizzer::handleResult(shared_ptr<TestResult> result) {
+  showDisplayUpdates();
+  auto queue = runner_.stats();
+  QLOG_DEBUG() << "keystroke queue:" << queue.keystrokes << "keys,"
+               << queue.dropped << "dropped, max depth" << queue.max_depth
+               << "," << queue.dropped_updates << "display updates dropped";
+  QLOG_DEBUG().noquote() << "keystroke latency:\n"
+                         << runner_.trace().report();
   QLOG_INFO() << "wpm:" << result->wpm << "acc:" << result->accuracy
               << "vis:" << result->viscosity;
-  if (performance_logging_) {
-    TestSaver* saver = new TestSaver(result);
-    saver->setAutoDelete(true);
-    connect(result.get(), &TestResult::savedResult, this, &Quizzer::newResult);
-    connect(result.get(), &TestResult::savedStatistics, this,
-            &Quizzer::newStatistics);
-    QThreadPool::globalInstance()->start(saver);
+  if (!result->key_timings.empty()) {
+    double dwell = 0, flight = 0;
+    int keys = 0, bigrams = 0, overlaps = 0;
+    for (const auto& timing : result->key_timings) {
+      const auto& t = timing.second;
+      if (timing.first.length() == 1) {
+        dwell += t.dwell * t.count;
+        keys += t.count;
+      } else {
+        flight += t.flight * t.count;
+        bigrams += t.count;
+        overlaps += t.overlaps;
+      }
+    }
+    QLOG_DEBUG() << "dwell:" << dwell / std::max(1, keys)
+                 << "ms flight:" << flight / std::max(1, bigrams)
+                 << "ms overlaps:" << overlaps << "of" << bigrams;
   }
+  // ranked before the saver adds it to the results.
+  QString rank = rankText(*result);
+  bool upgrading = performance_logging_ && Database::readOnly();
+  if (upgrading)
+    unsaved_.push_back(result);
+  else if (performance_logging_)
+    saveResult(result);
   setPreviousResultText(result->wpm, result->accuracy);
 
   // repeat if targets not met, otherwise get next text
@@ -286,12 +462,50 @@ void Quizzer::handleResult(shared_ptr<TestResult> result) {
     setText(result->text);
   } else {
     success_sound_.play();
-    ui->alertLabel->hide();
-    setText(result->text->nextText());
+    if (rank.isEmpty())
+      ui->alertLabel->hide();
+    else
+      alertText(rank);
+    setText(prefetcher_.next(result->text->nextTextSelectionPreference(),
+                             result->text));
   }
+  if (upgrading) alertText("Saving Result After Profile Upgrade");
+}
+
+void Quizzer::saveResult(const shared_ptr<TestResult>& result) {
+  TestSaver* saver = new TestSaver(result);
+  saver->setAutoDelete(true);
+  connect(result.get(), &TestResult::savedResult, this, &Quizzer::newResult);
+  // the recent results only include this one once it's saved.
+  double wpm = result->wpm, accuracy = result->accuracy;
+  connect(result.get(), &TestResult::savedResult, this,
+          [this, wpm, accuracy] { setPreviousResultText(wpm, accuracy); });
+  connect(result.get(), &TestResult::savedStatistics, this,
+          &Quizzer::newStatistics);
+  QThreadPool::globalInstance()->start(saver);
+}
+
+QString Quizzer::rankText(const TestResult& result) {
+  using Scope = ResultRanks::Scope;
+  auto ranks = db_->resultRanks();
+  auto wpm = RecentResults::Wpm;
+  auto all = ranks->rank(wpm, result.wpm);
+  if (!all.count) return QString();
+  if (!all.better) return "Personal Best!";
+  int source = result.text->source();
+  auto in_source = ranks->rank(wpm, result.wpm, Scope::Source, source);
+  if (in_source.count && !in_source.better) return "Best on this Source!";
+  int text = result.text->id();
+  auto in_text = ranks->rank(wpm, result.wpm, Scope::Text, text);
+  if (in_text.count && !in_text.better) return "Best on this Text!";
+  int top = static_cast<int>(std::ceil(100.0 * all.top()));
+  if (top <= 5) return QString("Top %1% Run").arg(std::max(1, top));
+  return QString();
 }
 
 TestSaver::TestSaver(const shared_ptr<TestResult>& result)
     : QRunnable(), result_(result) {}
 
 void TestSaver::run() { result_->save(); }
+
+void RanksLoader::run() { Database().resultRanks(); }
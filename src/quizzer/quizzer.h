@@ -22,7 +22,8 @@
 #include <QAction>
 #include <QColor>
 #include <QFocusEvent>
-#include <QPlainTextEdit>
+#include <QKeyEvent>
+#include <QLabel>
 #include <QPoint>
 #include <QRunnable>
 #include <QSoundEffect>
@@ -33,14 +34,17 @@
 #include <QWidget>
 
 #include <memory>
+#include <vector>
 
 #include "database/db.h"
 #include "defs.h"
 #include "quizzer/test.h"
 #include "quizzer/testresult.h"
+#include "quizzer/testrunner.h"
 #include "quizzer/typerdisplay.h"
 #include "texts/library.h"
 #include "texts/text.h"
+#include "texts/textprefetcher.h"
 
 using std::shared_ptr;
 using std::unique_ptr;
@@ -60,6 +64,10 @@ class Quizzer : public QWidget, public AmphetypeWindow {
   ~Quizzer();
   QAction *restartAction();
   QAction *cancelAction();
+  QAction *latencyOverlayAction();
+  QAction *latencyDumpAction();
+  //! the texts selected ahead of the current test.
+  TextPrefetcher *prefetcher();
 
  public slots:
   void onProfileChange() override;
@@ -84,10 +92,13 @@ class Quizzer : public QWidget, public AmphetypeWindow {
   void timerLabelGo();
   void timerLabelStop();
   void handleResult(shared_ptr<TestResult>);
+  void showDisplayUpdates();
+  void showLatencyOverlay(bool);
+  void updateLatencyOverlay();
+  void dumpLatencyTrace();
 
  signals:
   void colorChanged();
-  void newInput(const QString &, int = -1);
   void newWpm(const QPoint &, const QPoint &);
   void newResult(int);
   void newStatistics();
@@ -95,16 +106,36 @@ class Quizzer : public QWidget, public AmphetypeWindow {
 
  protected:
   void keyPressEvent(QKeyEvent *event) override;
+  void keyReleaseEvent(QKeyEvent *event) override;
 
  private:
+  //! \param key the key that typed it, to match its release. 0 for none.
+  /*! queue `key` for the test, restarting it if the queue was full.
+    Returns false if it was restarted. */
+  bool postKey(const Keystroke& key);
+  void insertKey(QChar c, qint64 ns, int key = 0);
+  void eraseKey(qint64 ns, int key = 0);
+  //! save a result on the thread pool.
+  void saveResult(const shared_ptr<TestResult> &result);
+  /*! how a result ranks against the saved ones, empty unless it's among
+    the best. */
+  QString rankText(const TestResult &result);
+
   unique_ptr<Ui::Quizzer> ui;
   unique_ptr<Database> db_;
   unique_ptr<Test> test_;
+  TextPrefetcher prefetcher_;
   QAction action_restart_;
   QAction action_cancel_;
-  QThread test_thread_;
-  //! A text edit not added to the UI that will handle key events.
-  QPlainTextEdit text_edit_;
+  QAction action_latency_overlay_;
+  QAction action_latency_dump_;
+  TestRunner runner_;
+  QLabel *latency_overlay_;
+  QTimer latency_timer_;
+  //! the typed input, Test gets the changes to it as Keystrokes.
+  QString input_;
+  //! the test starts with a space that isn't part of the input.
+  bool waiting_for_space_ = false;
   QTimer lesson_timer_;
   QTime lesson_time_;
   QColor go_color_;
@@ -113,6 +144,8 @@ class Quizzer : public QWidget, public AmphetypeWindow {
   double target_acc_;
   double target_vis_;
   bool performance_logging_;
+  //! results finished while the profile is upgraded, saved once it's done.
+  std::vector<shared_ptr<TestResult>> unsaved_;
   bool require_space_;
   QSoundEffect error_sound_;
   QSoundEffect success_sound_;
@@ -127,4 +160,11 @@ class TestSaver : public QRunnable {
   shared_ptr<TestResult> result_;
 };
 
+//! Loads the result ranks of the profile, so ranking the first result of a
+//! profile doesn't read every result on the GUI thread.
+class RanksLoader : public QRunnable {
+ public:
+  void run();
+};
+
 #endif  // SRC_QUIZZER_QUIZZER_H_
@@ -0,0 +1,136 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "quizzer/replay.h"
+
+#include <QThread>
+
+#include <QsLog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "database/db.h"
+#include "quizzer/keystrokelog.h"
+#include "quizzer/test.h"
+
+namespace {
+
+// results loaded, replayed and written at a time.
+static constexpr const int kBatchSize = 1000;
+
+}  // namespace
+
+namespace replay {
+
+std::shared_ptr<TestResult> run(const std::shared_ptr<Text>& text,
+                                const QByteArray& log) {
+  auto events = KeystrokeLog::decode(log, text->text());
+  int flags = KeystrokeLog::flags(log);
+  // older logs don't say. without require space the test starts on the first
+  // key, so only a test that was started by a space has a first key after
+  // 0 ms.
+  bool require_space = flags >= 0
+                           ? (flags & KeystrokeLog::RequireSpace) != 0
+                           : !events.empty() && events.front().ms > 0;
+
+  std::shared_ptr<TestResult> result;
+  Test test(text, require_space);
+  QObject::connect(
+      &test, &Test::resultReady,
+      [&result](const std::shared_ptr<TestResult>& r) { result = r; });
+  test.start(0);
+  for (int i = 0; i < static_cast<int>(events.size()); ++i) {
+    const auto& event = events[i];
+    auto type = Keystroke::Type::Insert;
+    // releases are matched to their keystroke by its index.
+    int key = i + 1;
+    if (event.type == KeystrokeLog::Event::Type::Erase) {
+      type = Keystroke::Type::Erase;
+    } else if (event.type == KeystrokeLog::Event::Type::Release) {
+      type = Keystroke::Type::Release;
+      key = event.press + 1;
+    }
+    test.handleKeystroke(Keystroke{type, event.character, event.position,
+                                   event.ms * 1000000, key});
+  }
+  return result;
+}
+
+int replayProfile(Database* db, const std::function<void(int)>& progress) {
+  auto count = db->getOneRow("SELECT count() FROM keystroke_log");
+  int total = count.empty() ? 0 : count[0].toInt();
+  int workers = std::max(1, QThread::idealThreadCount());
+  QLOG_INFO() << "replaying" << total << "results on" << workers << "threads";
+
+  int replayed = 0;
+  int last_id = 0;
+  while (true) {
+    auto rows = db->getRows(
+        "SELECT log.result_id, text.id, text.source, text.text, log.data, "
+        " source.type "
+        "FROM keystroke_log AS log "
+        "JOIN result ON (result.id = log.result_id) "
+        "JOIN text ON (text.id = result.text_id) "
+        "LEFT JOIN source ON (source.id = text.source) "
+        "WHERE log.result_id > ? ORDER BY log.result_id LIMIT ?",
+        db_row{last_id, kBatchSize});
+    if (rows.empty()) break;
+    last_id = rows.back()[0].toInt();
+
+    // tests don't share anything, each thread takes the next row until
+    // there are none left.
+    std::vector<std::shared_ptr<TestResult>> results(rows.size());
+    std::atomic<size_t> next(0);
+    auto work = [&rows, &results, &next] {
+      for (size_t i = next++; i < rows.size(); i = next++) {
+        const auto& row = rows[i];
+        // the text decides what of the result is saved.
+        std::shared_ptr<Text> text;
+        if (row[5].toInt() == static_cast<int>(amphetype::text_type::Lesson)) {
+          text = std::make_shared<Lesson>(row[3].toString(), row[1].toInt(),
+                                          row[2].toInt(), QString(), 0);
+        } else {
+          text = std::make_shared<Text>(row[3].toString(), row[1].toInt(),
+                                        row[2].toInt());
+        }
+        results[i] = run(text, row[4].toByteArray());
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < workers; ++i) threads.emplace_back(work);
+    work();
+    for (auto& thread : threads) thread.join();
+
+    std::map<int, std::shared_ptr<TestResult>> finished;
+    for (size_t i = 0; i < rows.size(); ++i) {
+      if (results[i]) finished[rows[i][0].toInt()] = std::move(results[i]);
+    }
+    db->replaceResults(finished);
+
+    replayed += static_cast<int>(finished.size());
+    if (progress && total) progress(std::min(100, 100 * replayed / total));
+  }
+  QLOG_INFO() << "replayed" << replayed << "results";
+  return replayed;
+}
+
+}  // namespace replay
@@ -0,0 +1,49 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_QUIZZER_REPLAY_H_
+#define SRC_QUIZZER_REPLAY_H_
+
+#include <QByteArray>
+
+#include <functional>
+#include <memory>
+
+#include "quizzer/testresult.h"
+#include "texts/text.h"
+
+class Database;
+
+namespace replay {
+
+/*! Type `text` again as recorded in a KeystrokeLog, without a GUI or timers.
+  Returns null if the log doesn't finish the text. */
+std::shared_ptr<TestResult> run(const std::shared_ptr<Text>& text,
+                                const QByteArray& log);
+
+/*! Replay every result of the profile open in `db` that has a keystroke log
+  and replace its numbers, statistics and mistakes with the replayed ones.
+  Results are replayed in batches spread over all cores and each batch is
+  written in one transaction. `progress` gets the percentage replayed.
+  Returns the number of results replayed. */
+int replayProfile(Database* db,
+                  const std::function<void(int)>& progress = {});
+
+}  // namespace replay
+
+#endif  // SRC_QUIZZER_REPLAY_H_
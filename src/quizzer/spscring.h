@@ -0,0 +1,69 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_QUIZZER_SPSCRING_H_
+#define SRC_QUIZZER_SPSCRING_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/*! A fixed capacity ring buffer for passing values from one producer thread
+  to one consumer thread without locks or allocations. `N` must be a power
+  of two. */
+template <typename T, std::size_t N>
+class SpscRing {
+  static_assert(N && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+ public:
+  //! producer only. returns false if the ring is full.
+  bool push(const T& item) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == N) return false;
+    items_[tail & (N - 1)] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  //! consumer only. returns false if the ring is empty.
+  bool pop(T* item) {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) return false;
+    *item = items_[head & (N - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  //! the number of queued items, exact only on the producer or consumer.
+  std::size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+  static constexpr std::size_t capacity() { return N; }
+
+ private:
+  // head and tail on their own cache lines so the threads don't share one.
+  std::atomic<std::size_t> head_{0};
+  char head_padding_[64 - sizeof(std::atomic<std::size_t>)];
+  std::atomic<std::size_t> tail_{0};
+  char tail_padding_[64 - sizeof(std::atomic<std::size_t>)];
+  std::array<T, N> items_;
+};
+
+#endif  // SRC_QUIZZER_SPSCRING_H_
@@ -18,13 +18,13 @@
 
 #include "quizzer/test.h"
 
-#include <QRegularExpression>
+#include <QStringRef>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iterator>
 #include <memory>
-#include <numeric>
 
 #include <QsLog.h>
 
@@ -36,12 +36,14 @@
 using std::min;
 using std::max;
 using std::pow;
-using std::accumulate;
 using std::abs;
 using std::make_pair;
 using std::make_shared;
 
-double Test::wpm(int nchars, int ms) {
+//! the most characters to count mistakes between in a matrix, 256 KiB of it.
+static constexpr size_t kMaxAlphabet = 256;
+
+double Test::wpm(int nchars, double ms) {
   return 12000.0 * (nchars / static_cast<double>(ms));
 }
 
@@ -49,165 +51,339 @@ double Test::viscosity(double x, double avg) {
   return 100.0 * pow((x / avg) - 1, 2);
 }
 
+InputMatcher::InputMatcher(const QString& text) : text_(text) {
+  // room for some mistakes past the end, so typing doesn't have to grow it.
+  input_.reserve(2 * text.length() + 16);
+}
+
+void InputMatcher::edit(int position, int removed, const QString& added) {
+  input_.replace(position, removed, added);
+  correct_ = min(correct_, position);
+  advance();
+}
+
+void InputMatcher::insert(int position, QChar c) {
+  position = min(position, input_.length());
+  input_.insert(position, c);
+  correct_ = min(correct_, position);
+  advance();
+}
+
+void InputMatcher::erase(int position) {
+  if (position < 0 || position >= input_.length()) return;
+  input_.remove(position, 1);
+  correct_ = min(correct_, position);
+  advance();
+}
+
+void InputMatcher::reset(const QString& input) {
+  input_ = input;
+  correct_ = 0;
+  advance();
+}
+
+bool InputMatcher::complete() const {
+  return correct_ == text_.length() && input_.length() == correct_;
+}
+
+void InputMatcher::advance() {
+  int end = min(input_.length(), text_.length());
+  while (correct_ < end && input_[correct_] == text_[correct_]) ++correct_;
+}
+
 Test::Test(const shared_ptr<Text>& t, bool require_space, QObject* parent)
-    : QObject(parent), text_(t), require_space_(require_space) {
-  time_at_.resize(t->text().length());
+    : QObject(parent),
+      text_(t),
+      matcher_(t->text()),
+      require_space_(require_space),
+      analysis_(t->analysis(require_space)),
+      ngrams_(analysis_->ngrams()),
+      occurrence_mistakes_(analysis_->occurrences().size(), 0),
+      log_(t->text(), require_space ? KeystrokeLog::RequireSpace : 0) {
+  int length = t->text().length();
+  time_at_.resize(length);
+  ms_between_.resize(length);
+  ms_prefix_.assign(length + 1, 0.0);
+  ms_squared_prefix_.assign(length + 1, 0.0);
+  mistake_prefix_.assign(length + 1, 0);
+  // a mistake can be typed after the last character too.
+  mistakes_.assign(length + 1, false);
+  release_at_.assign(length, -1);
+
+  alphabet_.assign(t->text().begin(), t->text().end());
+  for (ushort c = 0x20; c < 0x7f; ++c) alphabet_.push_back(QChar(c));
+  std::sort(alphabet_.begin(), alphabet_.end());
+  alphabet_.erase(std::unique(alphabet_.begin(), alphabet_.end()),
+                  alphabet_.end());
+  if (alphabet_.size() > kMaxAlphabet) alphabet_.clear();
+  mistake_counts_.assign(alphabet_.size() * alphabet_.size(), 0);
 }
 
 const shared_ptr<Text>& Test::text() const { return text_; }
-int Test::msElapsed() const { return timer_.isValid() ? timer_.elapsed() : 0; }
+int Test::msElapsed() const {
+  return started_ ? (now() - start_ns_) / 1000000 : 0;
+}
 double Test::secondsElapsed() const { return msElapsed() / 1000.0; }
 
-void Test::start() {
-  QLOG_INFO() << "Test Starting." << text_->sourceName() << text_->textNumber();
+qint64 Test::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Test::start(qint64 ns) {
+  QLOG_DEBUG() << "Test Starting." << text_->sourceName()
+               << text_->textNumber();
   start_time_ = QDateTime::currentDateTime();
   started_ = true;
-  timer_.start();
+  start_ns_ = ns < 0 ? now() : ns;
   emit testStarted(text_->text().length());
 }
 
 void Test::finish() {
-  QLOG_INFO() << "Test Finished in " << time_at_.back() / 1000.0 << "seconds.";
+  QLOG_DEBUG() << "Test Finished in " << time_at_.back() / 1e9 << "seconds.";
   finished_ = true;
   prepareResult();
 }
 
 int Test::last_equal_position(const QString& a, const QString& b) {
-  int pos = -1;
-  for (int n = min(a.length(), b.length()); n >= 1; --n) {
-    if (a.leftRef(n) == b.leftRef(n)) return n - 1;
+  int n = min(a.length(), b.length());
+  return std::mismatch(a.begin(), a.begin() + n, b.begin()).first - a.begin() -
+         1;
+}
+
+bool Test::startOn(const QString& key, qint64 ns) {
+  if (started_) return true;
+  if (require_space_) {
+    if (key.right(1) == " ") {
+      emit startKeyReceived();
+      start(ns);
+    }
+    return false;
   }
-  return pos;
+  start(ns);
+  return true;
 }
 
 void Test::handleInput(const QString& input, int ms) {
+  if (finished_ || !startOn(input)) return;
+
+  const QString& before = matcher_.input();
+  int direction = input.length() - before.length();
+  qint64 ns = ms < 0 ? now() - start_ns_ : ms * 1000000LL;
+  int same = last_equal_position(before, input) + 1;
+  logEdit(same, before.length() - same, input.midRef(same), ns);
+  matcher_.reset(input);
+  processInput(direction, ns);
+}
+
+void Test::handleEdit(int position, int removed, const QString& added,
+                      int ms) {
+  if (finished_ || !startOn(added)) return;
+
+  qint64 ns = ms < 0 ? now() - start_ns_ : ms * 1000000LL;
+  logEdit(position, removed, QStringRef(&added), ns);
+  matcher_.edit(position, removed, added);
+  processInput(added.length() - removed, ns);
+}
+
+void Test::handleKeystroke(const Keystroke& key) {
   if (finished_) return;
+  if (key.type == Keystroke::Type::Insert) {
+    if (!started_ && !startOn(key.character, key.ns)) return;
+    qint64 ns = key.ns < 0 ? now() - start_ns_ : key.ns - start_ns_;
+    log_.insert(ns, key.character);
+    matcher_.insert(key.position, key.character);
+    processInput(1, ns);
+    if (key.key) hold(key.key, key.position, ns);
+  } else if (started_) {
+    qint64 ns = key.ns < 0 ? now() - start_ns_ : key.ns - start_ns_;
+    if (key.type == Keystroke::Type::Release) return release(key.key, ns);
+    log_.erase(ns);
+    matcher_.erase(key.position);
+    processInput(-1, ns);
+    if (key.key) hold(key.key, -1, ns);
+  }
+}
 
-  if (!started_) {
-    if (require_space_) {
-      if (input.right(1) == " ") {
-        emit startKeyReceived();
-        start();
-      }
-      return;
-    } else {
-      start();
-    }
+void Test::hold(int key, int position, qint64 ns) {
+  // only a character completed by this very keystroke gets its key's timing.
+  if (position < 0 || position >= completed_ || time_at_[position] != ns)
+    position = -1;
+  if (held_count_ == kMaxHeld) {
+    std::move(held_ + 1, held_ + held_count_, held_);
+    --held_count_;
+  }
+  held_[held_count_++] = HeldKey{key, log_.size() - 1, position, ns};
+}
+
+void Test::release(int key, qint64 ns) {
+  for (int i = held_count_ - 1; i >= 0; --i) {
+    const auto& held = held_[i];
+    if (held.key != key) continue;
+    log_.release(log_.size() - 1 - held.keystroke, ns - held.ns);
+    if (held.position >= 0 && time_at_[held.position] == held.ns)
+      release_at_[held.position] = ns;
+    std::move(held_ + i + 1, held_ + held_count_, held_ + i);
+    --held_count_;
+    return;
   }
+}
+
+void Test::logEdit(int position, int removed, const QStringRef& added,
+                   qint64 ns) {
+  // the log only changes the end of the input, so the rest of the input after
+  // the edit is erased and typed again.
+  const QString& input = matcher_.input();
+  position = min(position, input.length());
+  auto rest = input.midRef(min(position + removed, input.length()));
+  for (int i = position; i < input.length(); ++i) log_.erase(ns);
+  for (QChar c : added) log_.insert(ns, c);
+  for (QChar c : rest) log_.insert(ns, c);
+}
 
-  int direction = input.length() - last_input_length_;
-  last_input_length_ = input.length();
-  int pos = last_equal_position(input, text_->text());
-  int mistake_count = abs(pos - input.length() + 1);
+void Test::processInput(int direction, qint64 ns) {
+  const QString& input = matcher_.input();
+  int pos = matcher_.correct() - 1;
+  int mistake_count = matcher_.errors();
 
   emit positionChanged(pos + 1, input.length());
+  // characters that were erased are completed again when they're retyped.
+  completed_ = min(completed_, matcher_.correct());
   if (direction < 0 || mistake_count > 1) return;
   if (!mistake_count && !input.isEmpty()) {
-    time_at_[pos] = ms < 0 ? msElapsed() : ms;
+    for (; completed_ <= pos; ++completed_) complete(completed_, ns);
     if (pos > apm_window_) {
-      auto window_ms = time_at_[pos] - time_at_[pos - apm_window_];
-      emit newWpm(QPoint(pos, wpm(input.length(), time_at_[pos])),
+      auto window_ms = (time_at_[pos] - time_at_[pos - apm_window_]) / 1e6;
+      emit newWpm(QPoint(pos, wpm(input.length(), time_at_[pos] / 1e6)),
                   QPoint(pos, wpm(apm_window_, window_ms)));
     }
   } else if (mistake_count) {  // Mistake handling
-    QLOG_INFO() << "Mistake!"
-                << "input:" << input[pos + 1]
-                << "expected:" << text_->text()[pos + 1] << "at" << pos;
-    mistakes_.insert(pos + 1);
-    auto pair = make_pair(text_->text()[pos + 1], input[pos + 1]);
-    mistake_list_[pair] += 1;
+    if (!mistakes_[pos + 1]) {
+      mistakes_[pos + 1] = true;
+      ++mistaken_;
+    }
+    countMistake(text_->text()[pos + 1], input[pos + 1]);
     emit mistake(pos);
   }
 
   // Completion
-  if (input == text_->text()) return finish();
+  if (matcher_.complete()) return finish();
 }
 
 void Test::prepareResult() {
-  ms_between_.push_back(time_at_.front());
-  for (auto i = time_at_.begin() + 1; i != time_at_.end(); ++i)
-    ms_between_.push_back(*(i) - *(i - 1));
-
-  double wpm = this->wpm(text_->text().length(), time_at_.back());
-  double accuracy =
-      1.0 - mistakes_.size() / static_cast<double>(text_->text().length());
-  double viscosity =
-      time_and_viscosity_for_range(0, text_->text().length() - 1).second;
-
-  ngram_stats time_values, visc_values;
-  ngram_count mistake_count;
-  processCharacters(mistake_count, time_values, visc_values);
-  processTrigrams(mistake_count, time_values, visc_values);
-  processWords(mistake_count, time_values, visc_values);
+  const auto& text = text_->text();
+  // the viscosity of a character is relative to the speed of the whole test,
+  // so it's the only thing that has to wait until the end.
+  double ms_per_char = time_at_.back() / 1e6 / text.length();
+  const auto& char_samples = analysis_->charSamples();
+  for (int i = 0; i < text.length(); ++i) {
+    if (char_samples[i] < 0) continue;
+    ngrams_.setSample(char_samples[i], ms_between_[i] / 1000.0,
+                      viscosity(ms_between_[i], ms_per_char));
+  }
+
+  double wpm = this->wpm(text.length(), time_at_.back() / 1e6);
+  double accuracy = 1.0 - mistaken_ / static_cast<double>(text.length());
+  double viscosity = time_and_viscosity_for_range(0, text.length() - 1).second;
+
+  int n = static_cast<int>(alphabet_.size());
+  for (int i = 0; i < n * n; ++i) {
+    if (!mistake_counts_[i]) continue;
+    mistake_list_[make_pair(alphabet_[i / n], alphabet_[i % n])] +=
+        mistake_counts_[i];
+  }
 
   auto result = make_shared<TestResult>(
       text_, QDateTime::currentDateTime(), wpm, accuracy, viscosity,
-      time_values, visc_values, mistake_count, mistake_list_);
+      std::move(ngrams_), std::move(mistake_list_), keyTimings(), log_.take());
+  result->analysis = analysis_;
   emit resultReady(result);
 }
 
 pair<double, double> Test::time_and_viscosity_for_range(int start,
                                                         int end) const {
   double n = static_cast<double>(max(1, abs(end - start)));
-  double total_time =
-      accumulate(ms_between_.begin() + start, ms_between_.begin() + end, 0.0);
+  double total_time = ms_prefix_[end] - ms_prefix_[start];
+  double total_squared = ms_squared_prefix_[end] - ms_squared_prefix_[start];
   double avg_ms = total_time / n;
-  double visc_sum = accumulate(
-      ms_between_.begin() + start, ms_between_.begin() + end, 0.0,
-      [&avg_ms](auto a, auto b) { return a + viscosity(b, avg_ms); });
-  return make_pair(avg_ms, visc_sum / n);
-}
-
-void Test::processCharacters(ngram_count& mistake_count,
-                             ngram_stats& time_values,
-                             ngram_stats& visc_values) {
-  double ms_per_char = time_at_.back() / text_->text().length();
-  int offset = require_space_ ? 0 : 1;
-  for (int i = 0; i < text_->text().length(); ++i) {
-    auto key = text_->text().mid(i, 1);
-    if (mistakes_.count(i)) mistake_count[key]++;
-    if (i >= offset) {
-      time_values[key].push_back(ms_between_[i] / 1000.0);
-      visc_values[key].push_back(viscosity(ms_between_[i], ms_per_char));
-    }
+  // sum of viscosity(x, avg) over the range, expanded so it only needs the
+  // sums of x and x^2.
+  double visc_sum = 100.0 * (total_squared / (avg_ms * avg_ms) -
+                             2.0 * total_time / avg_ms + (end - start));
+  return make_pair(avg_ms, max(0.0, visc_sum) / n);
+}
+
+int Test::mistakes_in_range(int start, int end) const {
+  return mistake_prefix_[end] - mistake_prefix_[start];
+}
+
+map<QString, KeyTiming> Test::keyTimings() const {
+  const auto& text = text_->text();
+  map<QString, KeyTiming> timings;
+  // a release from before the press is left over from an erased character.
+  auto released = [this](int p) { return release_at_[p] >= time_at_[p]; };
+  for (int p = 0; p < text.length(); ++p) {
+    if (!released(p)) continue;
+    auto& key = timings[text.mid(p, 1)];
+    key.dwell += (release_at_[p] - time_at_[p]) / 1e6;
+    ++key.count;
+  }
+  for (int p = 1; p < text.length(); ++p) {
+    if (!released(p - 1)) continue;
+    auto& bigram = timings[text.mid(p - 1, 2)];
+    double flight = (time_at_[p] - release_at_[p - 1]) / 1e6;
+    bigram.flight += flight;
+    if (flight < 0) ++bigram.overlaps;
+    ++bigram.count;
   }
+  for (auto& timing : timings) {
+    timing.second.dwell /= timing.second.count;
+    timing.second.flight /= timing.second.count;
+  }
+  return timings;
 }
 
-void Test::processTrigrams(ngram_count& mistake_count, ngram_stats& time_values,
-                           ngram_stats& visc_values) {
-  int offset = require_space_ ? 0 : 1;
-  for (int i = 0; i < text_->text().length() - 2; ++i) {
-    auto trigram = text_->text().mid(i, 3);
-    int start = i;
-    int end = i + 3;
-    for (int char_position = start; char_position < end; ++char_position) {
-      if (mistakes_.count(char_position)) mistake_count[trigram]++;
-    }
-    if (i >= offset) {  // time isn't valid for char 0
-      auto stats = time_and_viscosity_for_range(start, end);
-      time_values[trigram].push_back(stats.first / 1000.0);
-      visc_values[trigram].push_back(stats.second);
-    }
+int Test::letter(QChar c) const {
+  auto it = std::lower_bound(alphabet_.begin(), alphabet_.end(), c);
+  return it != alphabet_.end() && *it == c ? it - alphabet_.begin() : -1;
+}
+
+void Test::countMistake(QChar expected, QChar typed) {
+  int e = letter(expected);
+  int t = letter(typed);
+  if (e >= 0 && t >= 0) {
+    ++mistake_counts_[e * alphabet_.size() + t];
+  } else {
+    // only characters that aren't in the text or ASCII end up here.
+    mistake_list_[make_pair(expected, typed)] += 1;
   }
 }
 
-void Test::processWords(ngram_count& mistake_count, ngram_stats& time_values,
-                        ngram_stats& visc_values) {
-  QRegularExpression re("((\\w|'(?![A-Z]))+(-\\w(\\w|')*)*)",
-                        QRegularExpression::UseUnicodePropertiesOption);
-  auto i = re.globalMatch(text_->text());
-  while (i.hasNext()) {
-    auto match = i.next();
-    if (match.capturedLength() <= 3) continue;
-    int start = match.capturedStart();
-    int end = match.capturedEnd();
-    auto word = text_->text().mid(start, match.capturedLength());
-    for (int char_position = start; char_position < end; ++char_position) {
-      if (mistakes_.count(char_position)) mistake_count[word]++;
+void Test::complete(int position, qint64 ns) {
+  time_at_[position] = ns;
+  double ms = (position ? time_at_[position] - time_at_[position - 1] : ns) /
+              1e6;
+  ms_between_[position] = ms;
+  ms_prefix_[position + 1] = ms_prefix_[position] + ms;
+  ms_squared_prefix_[position + 1] = ms_squared_prefix_[position] + ms * ms;
+  mistake_prefix_[position + 1] = mistake_prefix_[position] +
+                                  (mistakes_[position] ? 1 : 0);
+
+  const auto& occurrences = analysis_->occurrences();
+  for (int i = analysis_->occurrencesBegin(position);
+       i < analysis_->occurrencesEnd(position); ++i) {
+    const auto& o = occurrences[i];
+    int mistakes = mistakes_in_range(o.start, o.end);
+    ngrams_.addMistakes(o.ngram, mistakes - occurrence_mistakes_[i]);
+    occurrence_mistakes_[i] = mistakes;
+    if (o.sample < 0) continue;
+    if (o.end - o.start == 1) {
+      // its viscosity needs the speed of the whole test, see prepareResult.
+      ngrams_.setSample(o.sample, ms / 1000.0, 0.0);
+    } else {
+      auto stats = time_and_viscosity_for_range(o.time_start, o.end);
+      ngrams_.setSample(o.sample, stats.first / 1000.0, stats.second);
     }
-    if (start == 0 && !require_space_) start = 1;
-    auto stats = time_and_viscosity_for_range(start, end);
-    time_values[word].push_back(stats.first / 1000.0);
-    visc_values[word].push_back(stats.second);
   }
 }
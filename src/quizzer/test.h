@@ -19,8 +19,9 @@
 #ifndef SRC_QUIZZER_TEST_H_
 #define SRC_QUIZZER_TEST_H_
 
+#include <QChar>
 #include <QDateTime>
-#include <QElapsedTimer>
+#include <QMetaType>
 #include <QObject>
 #include <QPoint>
 #include <QString>
@@ -31,8 +32,10 @@
 #include <utility>
 #include <vector>
 
+#include "quizzer/keystrokelog.h"
 #include "quizzer/testresult.h"
 #include "texts/text.h"
+#include "texts/textanalysis.h"
 
 using std::shared_ptr;
 using std::vector;
@@ -40,6 +43,51 @@ using std::map;
 using std::set;
 using std::pair;
 
+//! A single change of the typed input, or the release of a key.
+struct Keystroke {
+  enum class Type : quint8 { Insert, Erase, Release };
+  Type type;
+  //! the inserted character.
+  QChar character;
+  //! where the character was inserted, or the one that was erased.
+  int position;
+  //! when the key was pressed or released, from Test::now(). -1 to use the
+  //! time it's processed.
+  qint64 ns;
+  //! the key that was pressed or released, to match them up. 0 if unknown.
+  int key = 0;
+};
+
+Q_DECLARE_METATYPE(Keystroke)
+
+/*! Keeps track of how much of the input matches the text while it's being
+  edited. The correct prefix only moves back to where an edit happened and
+  forward over the characters that match again, so typing at the end costs
+  O(1) amortized per character however long the text is. */
+class InputMatcher {
+ public:
+  explicit InputMatcher(const QString& text);
+  //! replace `removed` characters at `position` of the input with `added`.
+  void edit(int position, int removed, const QString& added);
+  void insert(int position, QChar c);
+  void erase(int position);
+  //! compare a whole new input, for changes that aren't known as an edit.
+  void reset(const QString& input);
+  //! the length of the correct prefix of the input.
+  int correct() const { return correct_; }
+  //! the number of characters after the correct prefix.
+  int errors() const { return input_.length() - correct_; }
+  bool complete() const;
+  const QString& input() const { return input_; }
+
+ private:
+  void advance();
+
+  QString text_;
+  QString input_;
+  int correct_ = 0;
+};
+
 class Test : public QObject {
   Q_OBJECT
 
@@ -48,17 +96,25 @@ class Test : public QObject {
        QObject* parent = Q_NULLPTR);
   int msElapsed() const;
   double secondsElapsed() const;
+  //! a monotonic time in ns, for timestamping keystrokes as they happen.
+  static qint64 now();
   const shared_ptr<Text>& text() const;
   bool started() const { return started_; }
   bool finished() const { return finished_; }
-  void start();
+  //! \param ns when the test started, from now(). -1 for now.
+  void start(qint64 ns = -1);
   static int last_equal_position(const QString& a, const QString& b);
   /*! return the wpm for n characters over ms time. 1 word = 5 chars */
-  static double wpm(int nchars, int ms);
+  static double wpm(int nchars, double ms);
   static double viscosity(double x, double avg);
 
  public slots:
+  //! the whole input typed so far.
   void handleInput(const QString& input, int ms = -1);
+  //! an edit of the input, see InputMatcher::edit.
+  void handleEdit(int position, int removed, const QString& added,
+                  int ms = -1);
+  void handleKeystroke(const Keystroke& key);
 
  signals:
   void testStarted(int);
@@ -69,27 +125,84 @@ class Test : public QObject {
   void startKeyReceived();
 
  private:
+  //! start the test if `key` is allowed to, returns false if it isn't.
+  bool startOn(const QString& key, qint64 ns = -1);
+  //! log replacing `removed` characters of the input at `position`.
+  void logEdit(int position, int removed, const QStringRef& added, qint64 ns);
+  //! react to the matcher's state after the input changed in length.
+  //! \param ns the time since the start of the test.
+  void processInput(int direction, qint64 ns);
   void finish();
   void prepareResult();
+  //! the average time and viscosity of characters [start, end).
   pair<double, double> time_and_viscosity_for_range(int start,
                                                          int end) const;
-  void processCharacters(ngram_count&, ngram_stats&, ngram_stats&);
-  void processTrigrams(ngram_count&, ngram_stats&, ngram_stats&);
-  void processWords(ngram_count&, ngram_stats&, ngram_stats&);
+  //! the number of characters in [start, end) that were mistyped.
+  int mistakes_in_range(int start, int end) const;
+  //! the index of `c` in alphabet_, or -1.
+  int letter(QChar c) const;
+  void countMistake(QChar expected, QChar typed);
+  //! the character at `position` was typed correctly, update its ngrams.
+  void complete(int position, qint64 ns);
+  //! remember that `key` is held down since the last logged keystroke.
+  void hold(int key, int position, qint64 ns);
+  void release(int key, qint64 ns);
+  //! the dwell of each character and flight of each bigram.
+  map<QString, KeyTiming> keyTimings() const;
 
  private:
   bool started_ = false;
   bool finished_ = false;
   bool require_space_ = false;
-  int last_input_length_ = 0;
   int apm_window_ = 5;
   shared_ptr<Text> text_;
+  InputMatcher matcher_;
   QDateTime start_time_;
-  vector<int> ms_between_;
-  vector<int> time_at_;
-  set<int> mistakes_;
+  //! the time between each character and the one before it.
+  vector<double> ms_between_;
+  //! prefix sums of ms_between_, its squares and of mistakes, built while
+  //! typing. element i covers the first i characters.
+  vector<double> ms_prefix_;
+  vector<double> ms_squared_prefix_;
+  vector<int> mistake_prefix_;
+  //! when each character was typed, in ns since the start.
+  vector<qint64> time_at_;
+  //! the characters that were mistyped at least once, and how many.
+  vector<bool> mistakes_;
+  int mistaken_ = 0;
+  //! the distinct characters of the text and the printable ASCII ones,
+  //! sorted. empty if there are too many to count mistakes in a matrix.
+  vector<QChar> alphabet_;
+  //! how often each character of alphabet_ was typed instead of another.
+  vector<int> mistake_counts_;
+  //! mistakes that don't fit in mistake_counts_.
   map<mistake_t, int> mistake_list_;
-  QElapsedTimer timer_;
+  qint64 start_ns_ = 0;
+
+  shared_ptr<const TextAnalysis> analysis_;
+  //! the samples of this test, a copy of the analysis' table.
+  NgramTable ngrams_;
+  //! the mistakes counted so far for each of the analysis' occurrences.
+  vector<int> occurrence_mistakes_;
+  //! the characters that have been typed correctly and counted.
+  int completed_ = 0;
+  KeystrokeLog log_;
+
+  //! a key that is held down.
+  struct HeldKey {
+    int key;
+    //! the keystroke in log_ it made.
+    int keystroke;
+    //! the character it typed correctly, or -1.
+    int position;
+    qint64 ns;
+  };
+  //! the most keys that are tracked at once, the oldest is forgotten.
+  static constexpr int kMaxHeld = 16;
+  HeldKey held_[kMaxHeld];
+  int held_count_ = 0;
+  //! when the key of each character was released, -1 if it wasn't yet.
+  vector<qint64> release_at_;
 };
 
 #endif  // SRC_QUIZZER_TEST_H_
@@ -4,36 +4,82 @@
 
 #include "database/db.h"
 
+NgramTable::NgramTable(int size_hint) {
+  index_.reserve(size_hint);
+  ngrams_.reserve(size_hint);
+  mistakes_.reserve(size_hint);
+}
+
+int NgramTable::intern(const QStringRef& ngram) {
+  auto it = index_.constFind(ngram);
+  if (it != index_.constEnd()) return it.value();
+  int id = size();
+  index_.insert(ngram, id);
+  ngrams_.push_back(ngram);
+  mistakes_.push_back(0);
+  return id;
+}
+
+int NgramTable::find(const QStringRef& ngram) const {
+  return index_.value(ngram, -1);
+}
+
+void NgramTable::addMistakes(int id, int count) { mistakes_[id] += count; }
+
+int NgramTable::addSample(int id, double time, double viscosity) {
+  sample_ids_.push_back(id);
+  times_.push_back(time);
+  viscosities_.push_back(viscosity);
+  return static_cast<int>(sample_ids_.size()) - 1;
+}
+
+void NgramTable::finish() {
+  // a counting sort of the samples by ngram id, keeping their order.
+  offsets_.assign(size() + 1, 0);
+  for (int id : sample_ids_) ++offsets_[id + 1];
+  for (int id = 0; id < size(); ++id) offsets_[id + 1] += offsets_[id];
+
+  vector<int> next(offsets_.begin(), offsets_.end() - 1);
+  vector<double> times(times_.size());
+  vector<double> viscosities(viscosities_.size());
+  slots_.resize(sample_ids_.size());
+  for (size_t i = 0; i < sample_ids_.size(); ++i) {
+    int to = next[sample_ids_[i]]++;
+    slots_[i] = to;
+    times[to] = times_[i];
+    viscosities[to] = viscosities_[i];
+  }
+  times_.swap(times);
+  viscosities_.swap(viscosities);
+  vector<int>().swap(sample_ids_);
+}
+
 TestResult::TestResult(const shared_ptr<Text>& text, const QDateTime& when,
                        double wpm, double accuracy, double viscosity,
-                       const ngram_stats& statsValues,
-                       const ngram_stats& viscValues,
-                       const ngram_count& mistakeCounts,
-                       const map<mistake_t, int>& mistakes,
-                       QObject* parent)
+                       NgramTable&& ngrams, map<mistake_t, int>&& mistakes,
+                       map<QString, KeyTiming>&& key_timings,
+                       QByteArray&& keystrokes, QObject* parent)
     : QObject(parent),
       text(text),
       when(when),
       wpm(wpm),
       accuracy(accuracy),
       viscosity(viscosity),
-      stats_values(statsValues),
-      viscosity_values(viscValues),
-      mistake_counts(mistakeCounts),
-      mistakes(mistakes) {}
+      ngrams(std::move(ngrams)),
+      mistakes(std::move(mistakes)),
+      key_timings(std::move(key_timings)),
+      keystrokes(std::move(keystrokes)) {}
 
 void TestResult::save() {
+  if (Database::readOnly()) {
+    QLOG_INFO() << "profile is being migrated, result not saved.";
+    return;
+  }
   Database db;
-  if (text->saveFlags() & amphetype::SaveFlags::SaveResults) {
-    db.addResult(this);
+  db.saveResult(this);
+  int flags = text->saveFlags();
+  if (flags & amphetype::SaveFlags::SaveResults)
     emit savedResult(text->source());
-  }
-  if (text->saveFlags() & amphetype::SaveFlags::SaveStatistics) {
-    db.addStatistics(this);
-    emit savedStatistics();
-  }
-  if (text->saveFlags() & amphetype::SaveFlags::SaveMistakes) {
-    db.addMistakes(this);
-    emit savedMistakes();
-  }
+  if (flags & amphetype::SaveFlags::SaveStatistics) emit savedStatistics();
+  if (flags & amphetype::SaveFlags::SaveMistakes) emit savedMistakes();
 }
@@ -19,15 +19,19 @@
 #ifndef SRC_QUIZZER_TESTRESULT_H_
 #define SRC_QUIZZER_TESTRESULT_H_
 
+#include <QByteArray>
 #include <QChar>
 #include <QDateTime>
+#include <QHash>
 #include <QMetaType>
 #include <QObject>
+#include <QString>
 #include <QStringRef>
 
 #include <map>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "texts/text.h"
 
@@ -36,29 +40,98 @@ using std::map;
 using std::pair;
 using std::vector;
 
-typedef map<QString, vector<double>> ngram_stats;
-typedef map<QString, int> ngram_count;
 typedef pair<QChar, QChar> mistake_t;
 
+class TextAnalysis;
+
+//! How long keys were held and the gaps between them, in ms.
+struct KeyTiming {
+  int count = 0;
+  //! for a character, the average time its key was held.
+  double dwell = 0.0;
+  //! for a bigram, the average time from releasing the first key to pressing
+  //! the second. negative when they overlapped.
+  double flight = 0.0;
+  //! for a bigram, how often the second key was pressed before the first was
+  //! released.
+  int overlaps = 0;
+};
+
+/*! The ngrams of a test and the samples recorded for each of them.
+
+  Ngrams are interned to dense ids and stored as views into the test's text,
+  so the text has to outlive the table. Samples are appended in any order and
+  grouped per ngram into one flat array by finish(), after which the samples
+  of an ngram are the contiguous range [times(id), times(id) + count(id)).
+  Samples can be added up front and filled in later through their slot.
+*/
+class NgramTable {
+ public:
+  explicit NgramTable(int size_hint = 0);
+  //! the id of `ngram`, adding it if it's new.
+  int intern(const QStringRef& ngram);
+  //! the id of `ngram`, or -1.
+  int find(const QStringRef& ngram) const;
+  void addMistakes(int id, int count);
+  //! returns the index of the sample, see slot().
+  int addSample(int id, double time, double viscosity);
+  //! group the samples by ngram, call once after everything was added.
+  void finish();
+  //! where the sample with the given index ended up after finish().
+  int slot(int sample) const { return slots_[sample]; }
+  void setSample(int slot, double time, double viscosity) {
+    times_[slot] = time;
+    viscosities_[slot] = viscosity;
+  }
+
+  int size() const { return static_cast<int>(ngrams_.size()); }
+  const QStringRef& ngram(int id) const { return ngrams_[id]; }
+  int mistakes(int id) const { return mistakes_[id]; }
+  int count(int id) const { return offsets_[id + 1] - offsets_[id]; }
+  double* times(int id) { return times_.data() + offsets_[id]; }
+  const double* times(int id) const { return times_.data() + offsets_[id]; }
+  double* viscosities(int id) { return viscosities_.data() + offsets_[id]; }
+  const double* viscosities(int id) const {
+    return viscosities_.data() + offsets_[id];
+  }
+
+ private:
+  QHash<QStringRef, int> index_;
+  vector<QStringRef> ngrams_;
+  vector<int> mistakes_;
+  //! where the samples of each ngram start, with the total at the end.
+  vector<int> offsets_;
+  //! the ngram of each sample until finish() groups them.
+  vector<int> sample_ids_;
+  vector<int> slots_;
+  vector<double> times_;
+  vector<double> viscosities_;
+};
+
 class TestResult : public QObject {
   Q_OBJECT
 
  public:
   TestResult(const shared_ptr<Text>& text, const QDateTime& when,
              double wpm, double accuracy, double viscosity,
-             const ngram_stats& statsValues, const ngram_stats& viscValues,
-             const ngram_count& mistakeCounts,
-             const map<mistake_t, int>& mistakes,
+             NgramTable&& ngrams, map<mistake_t, int>&& mistakes,
+             map<QString, KeyTiming>&& key_timings, QByteArray&& keystrokes,
              QObject* parent = Q_NULLPTR);
   const QDateTime when;
   const shared_ptr<Text> text;
   const double wpm;
   const double viscosity;
   const double accuracy;
-  ngram_stats stats_values;
-  ngram_stats viscosity_values;
-  ngram_count mistake_counts;
+  NgramTable ngrams;
+  //! the analysis `ngrams` point into, kept for as long as the result.
+  shared_ptr<const TextAnalysis> analysis;
   map<mistake_t, int> mistakes;
+  //! keyed by characters and bigrams of the text.
+  map<QString, KeyTiming> key_timings;
+  //! the encoded KeystrokeLog of the test.
+  QByteArray keystrokes;
+  //! the id of the result once it's saved, -1 before.
+  long long id = -1;
   void save();
 
  signals:
@@ -0,0 +1,116 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "quizzer/testrunner.h"
+
+#include <QMutexLocker>
+
+TestRunner::TestRunner(QObject* parent) : QThread(parent) {}
+
+TestRunner::~TestRunner() {
+  stopping_ = true;
+  pending_.release();
+  wait();
+}
+
+void TestRunner::setTest(Test* test) {
+  QMutexLocker locker(&test_lock_);
+  ++generation_;
+  test_ = test;
+  if (!test) return;
+  connect(test, &Test::positionChanged, test,
+          [this](int position, int length) {
+            postUpdate(DisplayUpdate::Type::Position, position, length);
+          },
+          Qt::DirectConnection);
+  connect(test, &Test::newWpm, test,
+          [this](const QPoint& wpm, const QPoint& apm) {
+            postUpdate(DisplayUpdate::Type::Wpm, wpm.x(), wpm.y(), apm.x(),
+                       apm.y());
+          },
+          Qt::DirectConnection);
+  connect(test, &Test::mistake, test,
+          [this](int position) {
+            postUpdate(DisplayUpdate::Type::Mistake, position);
+          },
+          Qt::DirectConnection);
+}
+
+bool TestRunner::post(const Keystroke& key) {
+  if (!keys_.push(QueuedKeystroke{key, generation_})) {
+    ++dropped_;
+    return false;
+  }
+  int depth = static_cast<int>(keys_.size());
+  if (depth > max_depth_) max_depth_ = depth;
+  pending_.release();
+  return true;
+}
+
+bool TestRunner::takeUpdate(DisplayUpdate* update) {
+  // cleared before popping, an update pushed after the ring was drained
+  // emits updatesReady again.
+  updates_signalled_.exchange(false);
+  while (updates_.pop(update)) {
+    if (update->generation == generation_) return true;
+  }
+  return false;
+}
+
+KeystrokeQueueStats TestRunner::stats() const {
+  KeystrokeQueueStats stats;
+  stats.keystrokes = keystrokes_;
+  stats.dropped = dropped_;
+  stats.max_depth = max_depth_;
+  stats.dropped_updates = dropped_updates_;
+  return stats;
+}
+
+void TestRunner::resetStats() {
+  keystrokes_ = 0;
+  dropped_ = 0;
+  max_depth_ = 0;
+  dropped_updates_ = 0;
+}
+
+void TestRunner::run() {
+  QueuedKeystroke queued;
+  while (true) {
+    pending_.acquire();
+    if (stopping_) return;
+    QMutexLocker locker(&test_lock_);
+    while (keys_.pop(&queued)) {
+      ++keystrokes_;
+      key_ns_ = queued.key.ns;
+      qint64 start = Test::now();
+      if (key_ns_ >= 0) trace_.record(LatencyTrace::Queue, start - key_ns_);
+      if (test_ && queued.generation == generation_) {
+        test_->handleKeystroke(queued.key);
+        trace_.record(LatencyTrace::Process, Test::now() - start);
+      }
+    }
+  }
+}
+
+void TestRunner::postUpdate(DisplayUpdate::Type type, int a, int b, int c,
+                            int d) {
+  if (!updates_.push(DisplayUpdate{type, {a, b, c, d}, generation_, key_ns_,
+                                   Test::now()}))
+    ++dropped_updates_;
+  if (!updates_signalled_.exchange(true)) emit updatesReady();
+}
@@ -0,0 +1,115 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_QUIZZER_TESTRUNNER_H_
+#define SRC_QUIZZER_TESTRUNNER_H_
+
+#include <QMutex>
+#include <QSemaphore>
+#include <QThread>
+
+#include <atomic>
+
+#include "quizzer/latencytrace.h"
+#include "quizzer/spscring.h"
+#include "quizzer/test.h"
+
+//! A change to show in the typer display, made by the test.
+struct DisplayUpdate {
+  enum class Type : quint8 { Position, Wpm, Mistake };
+  Type type;
+  //! Position: position, input length. Wpm: the two points of Test::newWpm.
+  //! Mistake: position.
+  int values[4];
+  quint32 generation;
+  //! when the key that caused the update was pressed, -1 if unknown.
+  qint64 key_ns;
+  //! when the update was queued, from Test::now().
+  qint64 posted_ns;
+};
+
+//! Counters of the keystroke queue since the last reset.
+struct KeystrokeQueueStats {
+  quint64 keystrokes = 0;
+  quint64 dropped = 0;
+  int max_depth = 0;
+  //! display updates that didn't fit in their ring.
+  quint64 dropped_updates = 0;
+};
+
+/*! Runs a Test on its own thread. Keystrokes from the GUI thread and the
+  display updates made by the test go through a pair of lock free rings.
+  updatesReady wakes the GUI thread once when the updates ring stops being
+  empty, so only the first of a burst of updates posts an event. */
+class TestRunner : public QThread {
+  Q_OBJECT
+
+ public:
+  explicit TestRunner(QObject* parent = Q_NULLPTR);
+  ~TestRunner();
+  //! send keystrokes to `test` from now on, none of the queued ones.
+  void setTest(Test* test);
+  /*! queue a keystroke for the test, GUI thread only. Returns false if the
+    queue was full and the key was dropped, the test doesn't match the input
+    anymore then and has to be replaced. */
+  bool post(const Keystroke& key);
+  /*! take the next display update of the current test, GUI thread only.
+    Take them until none are left, updatesReady isn't emitted again before
+    that. */
+  bool takeUpdate(DisplayUpdate* update);
+  KeystrokeQueueStats stats() const;
+  void resetStats();
+  //! latencies of the keystrokes, the GUI thread adds its own stages.
+  LatencyTrace& trace() { return trace_; }
+
+ signals:
+  //! there are display updates to take, emitted from the test thread.
+  void updatesReady();
+
+ protected:
+  void run() override;
+
+ private:
+  struct QueuedKeystroke {
+    Keystroke key;
+    quint32 generation;
+  };
+
+  void postUpdate(DisplayUpdate::Type type, int a, int b = 0, int c = 0,
+                  int d = 0);
+
+  SpscRing<QueuedKeystroke, 1024> keys_;
+  SpscRing<DisplayUpdate, 1024> updates_;
+  QSemaphore pending_;
+  QMutex test_lock_;
+  Test* test_ = Q_NULLPTR;
+  std::atomic<quint32> generation_{0};
+  std::atomic<bool> stopping_{false};
+  //! set when updatesReady is emitted, cleared when the GUI starts taking.
+  std::atomic<bool> updates_signalled_{false};
+  //! when the key the test is handling was pressed, test thread only.
+  qint64 key_ns_ = -1;
+  LatencyTrace trace_;
+
+  std::atomic<quint64> keystrokes_{0};
+  std::atomic<quint64> dropped_{0};
+  std::atomic<int> max_depth_{0};
+  std::atomic<quint64> dropped_updates_{0};
+};
+
+#endif  // SRC_QUIZZER_TESTRUNNER_H_
@@ -20,6 +20,8 @@
 
 #include <utility>
 
+#include "quizzer/test.h"
+
 TyperDisplay::TyperDisplay(QWidget* parent)
     : QTextEdit(parent),
       testPosition(0),
@@ -39,6 +41,17 @@ QSize TyperDisplay::minimumSizeHint() const {
                this->document()->size().height() + 5);
 }
 
+void TyperDisplay::setLatencyTrace(LatencyTrace* trace) {
+  latencyTrace = trace;
+}
+
+void TyperDisplay::paintEvent(QPaintEvent* event) {
+  qint64 start = Test::now();
+  QTextEdit::paintEvent(event);
+  if (latencyTrace)
+    latencyTrace->record(LatencyTrace::Paint, Test::now() - start);
+}
+
 void TyperDisplay::setCols(int cols) {
   if (this->cols != cols) {
     this->cols = cols;
@@ -20,6 +20,7 @@
 #define SRC_QUIZZER_TYPERDISPLAY_H_
 
 #include <QColor>
+#include <QPaintEvent>
 #include <QSize>
 #include <QString>
 #include <QStringList>
@@ -28,6 +29,8 @@
 
 #include <utility>
 
+#include "quizzer/latencytrace.h"
+
 class TyperDisplay : public QTextEdit {
   Q_OBJECT
   Q_PROPERTY(QColor correctColor MEMBER correctColor NOTIFY colorChanged)
@@ -40,6 +43,11 @@ class TyperDisplay : public QTextEdit {
   void setTextTarget(const QString&);
 
   QSize minimumSizeHint() const;
+  //! record how long painting takes in `trace`.
+  void setLatencyTrace(LatencyTrace* trace);
+
+ protected:
+  void paintEvent(QPaintEvent* event) override;
 
  private:
   QColor correctColor;
@@ -51,6 +59,7 @@ class TyperDisplay : public QTextEdit {
   int cursorPosition;
   int testPosition;
   int cols;
+  LatencyTrace* latencyTrace = nullptr;
   std::pair<int, int> posToListPos(int);
 
  signals:
@@ -52,6 +52,8 @@ SettingsWidget::SettingsWidget(QWidget *parent)
           SLOT(saveSettings()));
   connect(ui->selectionMethod, SIGNAL(currentIndexChanged(int)), this,
           SLOT(saveSettings()));
+  connect(ui->archiveDaysSpinBox, SIGNAL(valueChanged(int)), this,
+          SLOT(saveSettings()));
 
   connect(ui->keyboardLayoutComboBox, SIGNAL(currentIndexChanged(int)), this,
           SLOT(changeKeyboardLayout(int)));
@@ -84,6 +86,7 @@ void SettingsWidget::loadSettings() {
   ui->targetWPMSpinBox->setValue(s.value("target_wpm", 50).toInt());
   ui->targetAccSpinBox->setValue(s.value("target_acc", 97).toDouble());
   ui->targetVisSpinBox->setValue(s.value("target_vis", 2).toDouble());
+  ui->archiveDaysSpinBox->setValue(s.value("archive_days", 0).toInt());
 
   ui->keyboardStandardComboBox->setCurrentIndex(
       s.value("keyboard_standard", 0).toInt());
@@ -102,6 +105,7 @@ void SettingsWidget::saveSettings() {
   s.setValue("target_wpm", ui->targetWPMSpinBox->value());
   s.setValue("target_acc", ui->targetAccSpinBox->value());
   s.setValue("target_vis", ui->targetVisSpinBox->value());
+  s.setValue("archive_days", ui->archiveDaysSpinBox->value());
   s.setValue(
       "perf_logging",
       ui->disablePerformanceLoggingCheckBox->checkState() == Qt::Checked);
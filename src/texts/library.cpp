@@ -30,6 +30,7 @@
 #include <QProgressDialog>
 #include <QSettings>
 #include <QString>
+#include <QThreadPool>
 #include <QUrl>
 #include <QXmlSchema>
 #include <QXmlSchemaValidator>
@@ -119,6 +120,28 @@ void Library::onProfileChange() {
   sourceHeader->setSectionResizeMode(1, QHeaderView::Stretch);
   textHeader->setSectionResizeMode(QHeaderView::ResizeToContents);
   textHeader->setSectionResizeMode(1, QHeaderView::Stretch);
+
+  // finish deleting sources that were interrupted last time.
+  if (!Database::readOnly()) {
+    auto hidden = db_->hiddenSources();
+    if (!hidden.isEmpty()) deleteSources(hidden);
+  }
+}
+
+void Library::deleteSources(const QList<int>& sources) {
+  auto task = new SourceDeleteTask(sources);
+  auto progress = new QProgressDialog(tr("Deleting..."), QString(), 0, 100);
+  progress->setWindowModality(Qt::NonModal);
+  progress->setMinimumDuration(500);
+  progress->setAutoClose(false);
+
+  connect(task, &SourceDeleteTask::progress, progress,
+          &QProgressDialog::setValue);
+  connect(task, &SourceDeleteTask::done, this, &Library::sourcesChanged);
+  connect(task, &SourceDeleteTask::done, progress,
+          &QProgressDialog::deleteLater);
+
+  QThreadPool::globalInstance()->start(task);
 }
 
 void Library::sourcesContextMenu(const QPoint& pos) {
@@ -139,11 +162,14 @@ void Library::sourcesContextMenu(const QPoint& pos) {
     msgBox.setInformativeText(
         tr("Deleting a source will delete all associated results."));
     if (msgBox.exec() == QMessageBox::Cancel) return;
-    db_source_model_->removeIndexes(selected);
+    // hidden right away, the texts and results are deleted in the background.
+    db_->hideSources(sources);
+    db_source_model_->removeIndexes(selected, false);
     db_text_model_->setPageSize(0);
     db_text_model_->clear();
     emit sourcesDeleted(sources);
     emit sourcesChanged();
+    deleteSources(sources);
   });
   connect(a_enable, &QAction::triggered, this, [this, sources] {
     db_->enableSource(sources);
@@ -364,3 +390,12 @@ bool Library::validateXml(QFile* file) {
   file->close();
   return v;
 }
+
+SourceDeleteTask::SourceDeleteTask(const QList<int>& sources)
+    : sources_(sources) {}
+
+void SourceDeleteTask::run() {
+  Database db;
+  db.deleteSource(sources_, [this](int percent) { emit progress(percent); });
+  emit done();
+}
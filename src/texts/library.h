@@ -24,6 +24,7 @@
 #include <QList>
 #include <QMainWindow>
 #include <QModelIndex>
+#include <QRunnable>
 
 #include <memory>
 
@@ -70,6 +71,7 @@ class Library : public QMainWindow, public AmphetypeWindow {
   void importSource();
   void sourcesContextMenu(const QPoint& pos);
   void textsContextMenu(const QPoint& pos);
+  void deleteSources(const QList<int>& sources);
 
  private:
   std::unique_ptr<Ui::Library> ui;
@@ -78,4 +80,20 @@ class Library : public QMainWindow, public AmphetypeWindow {
   std::unique_ptr<TextPagedDatabaseModel> db_text_model_;
 };
 
+//! Deletes sources with all their texts and results on a worker thread.
+class SourceDeleteTask : public QObject, public QRunnable {
+  Q_OBJECT
+
+ public:
+  explicit SourceDeleteTask(const QList<int>& sources);
+  void run() override;
+
+ signals:
+  void progress(int);
+  void done();
+
+ private:
+  QList<int> sources_;
+};
+
 #endif  // SRC_TEXTS_LIBRARY_H_
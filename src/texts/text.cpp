@@ -20,9 +20,12 @@
 
 #include <QSettings>
 
+#include <memory>
+
 #include <QsLog.h>
 
 #include "database/db.h"
+#include "texts/textanalysis.h"
 
 Text::Text(const QString& text, int id, int source, const QString& sName,
            int tNum)
@@ -50,7 +53,9 @@ Text::Text(const Text& other)
       source_(other.source_),
       text_(other.text_),
       source_name_(other.source_name_),
-      text_number_(other.text_number_) {}
+      text_number_(other.text_number_),
+      analysis_{std::atomic_load(&other.analysis_[0]),
+                std::atomic_load(&other.analysis_[1])} {}
 
 int Text::id() const { return id_; }
 int Text::source() const { return source_; }
@@ -58,6 +63,18 @@ const QString& Text::text() const { return text_; }
 const QString& Text::sourceName() const { return source_name_; }
 int Text::textNumber() const { return text_number_; }
 
+std::shared_ptr<const TextAnalysis> Text::analysis(bool require_space) const {
+  auto& cached = analysis_[require_space ? 1 : 0];
+  auto analysis = std::atomic_load(&cached);
+  if (!analysis) {
+    auto computed = TextAnalysis::get(id_, text_, require_space);
+    // when another thread got there first, its analysis is the one used.
+    if (std::atomic_compare_exchange_strong(&cached, &analysis, computed))
+      analysis = computed;
+  }
+  return analysis;
+}
+
 amphetype::text_type Text::type() const {
   return amphetype::text_type::Standard;
 }
@@ -74,32 +91,45 @@ std::shared_ptr<Text> Text::nextText() {
 
 std::shared_ptr<Text> Text::selectText(amphetype::SelectionMethod method,
                                        const Text* last) {
+  // repeating a text doesn't need a connection.
+  if (method == amphetype::SelectionMethod::Repeat)
+    return selectText(nullptr, method, last);
   Database db;
+  return selectText(&db, method, last);
+}
+
+std::shared_ptr<Text> Text::selectText(Database* db,
+                                       amphetype::SelectionMethod method,
+                                       const Text* last) {
   switch (method) {
     case amphetype::SelectionMethod::Random:
-      return db.getRandomText();
+      return db->getRandomText();
     case amphetype::SelectionMethod::InOrder:
-      return last == nullptr ? db.getNextText() : db.getNextText(*last);
+      return last == nullptr ? db->getNextText() : db->getNextText(*last);
     case amphetype::SelectionMethod::Repeat:
       return last == nullptr ? std::make_shared<Text>()
                              : std::make_shared<Text>(*last);
+    case amphetype::SelectionMethod::WeakSpots:
+      return db->textForWeakSpots(last);
+    case amphetype::SelectionMethod::SpacedRepetition:
+      return db->textFromReviews();
     case amphetype::SelectionMethod::SlowWords:
-      return db.textFromStats(amphetype::statistics::Order::Slow);
+      return db->textFromStats(amphetype::statistics::Order::Slow);
     case amphetype::SelectionMethod::FastWords:
-      return db.textFromStats(amphetype::statistics::Order::Fast);
+      return db->textFromStats(amphetype::statistics::Order::Fast);
     case amphetype::SelectionMethod::ViscousWords:
-      return db.textFromStats(amphetype::statistics::Order::Viscous);
+      return db->textFromStats(amphetype::statistics::Order::Viscous);
     case amphetype::SelectionMethod::FluidWords:
-      return db.textFromStats(amphetype::statistics::Order::Fluid);
+      return db->textFromStats(amphetype::statistics::Order::Fluid);
     case amphetype::SelectionMethod::InaccurateWords:
-      return db.textFromStats(amphetype::statistics::Order::Inaccurate);
+      return db->textFromStats(amphetype::statistics::Order::Inaccurate);
     case amphetype::SelectionMethod::AccurateWords:
-      return db.textFromStats(amphetype::statistics::Order::Accurate);
+      return db->textFromStats(amphetype::statistics::Order::Accurate);
     case amphetype::SelectionMethod::DamagingWords:
-      return db.textFromStats(amphetype::statistics::Order::Damaging);
+      return db->textFromStats(amphetype::statistics::Order::Damaging);
     default:
       Q_ASSERT(false);
-      return db.getRandomText();
+      return db->getRandomText();
   }
 }
 
@@ -161,3 +191,19 @@ int TextFromStats::saveFlags() const {
   return (amphetype::SaveFlags::SaveStatistics |
           amphetype::SaveFlags::SaveMistakes);
 }
+
+ReviewDrill::ReviewDrill(const QString& text)
+    : Text(text, -1, 0, "Review", -1) {}
+
+amphetype::text_type ReviewDrill::type() const {
+  return amphetype::text_type::GeneratedFromStatistics;
+}
+
+amphetype::SelectionMethod ReviewDrill::nextTextSelectionPreference() const {
+  return amphetype::SelectionMethod::SpacedRepetition;
+}
+
+int ReviewDrill::saveFlags() const {
+  return (amphetype::SaveFlags::SaveStatistics |
+          amphetype::SaveFlags::SaveMistakes);
+}
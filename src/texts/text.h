@@ -25,6 +25,9 @@
 
 #include "defs.h"
 
+class Database;
+class TextAnalysis;
+
 class TextInterface {
  public:
   virtual amphetype::text_type type() const = 0;
@@ -43,12 +46,19 @@ class Text : public TextInterface {
   const QString& text() const;
   const QString& sourceName() const;
   int textNumber() const;
+  /*! the ngrams of the text, worked out the first time they're needed and
+    kept for as long as the text (and its copies) are around. */
+  std::shared_ptr<const TextAnalysis> analysis(bool require_space) const;
 
   std::shared_ptr<Text> nextText();
 
   static std::shared_ptr<Text> selectText(
       amphetype::SelectionMethod method = amphetype::SelectionMethod::Random,
       const Text* last = nullptr);
+  //! select a text from the profile open in `db`.
+  static std::shared_ptr<Text> selectText(Database* db,
+                                          amphetype::SelectionMethod method,
+                                          const Text* last = nullptr);
 
   virtual amphetype::text_type type() const override;
   virtual amphetype::SelectionMethod nextTextSelectionPreference()
@@ -61,6 +71,8 @@ class Text : public TextInterface {
   QString text_;
   QString source_name_;
   int text_number_;
+  //! by require_space.
+  mutable std::shared_ptr<const TextAnalysis> analysis_[2];
 };
 
 class Lesson : public Text {
@@ -83,4 +95,13 @@ class TextFromStats : public Text {
   amphetype::statistics::Order stats_type_;
 };
 
+//! a drill of the words due for review, see ReviewSchedule.
+class ReviewDrill : public Text {
+ public:
+  explicit ReviewDrill(const QString& text);
+  amphetype::text_type type() const override;
+  amphetype::SelectionMethod nextTextSelectionPreference() const override;
+  int saveFlags() const override;
+};
+
 #endif  // SRC_TEXTS_TEXT_H_
@@ -0,0 +1,125 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "texts/textanalysis.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QStringRef>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+
+using std::make_shared;
+
+namespace {
+//! how many analyses of texts with an id are kept around.
+constexpr size_t kCacheSize = 16;
+
+QMutex cache_lock;
+//! the most recently used analysis is at the front.
+std::deque<shared_ptr<const TextAnalysis>> cache;
+std::deque<int> cache_ids;
+}  // namespace
+
+TextAnalysis::TextAnalysis(const QString& text, bool require_space)
+    : text_(text), require_space_(require_space), ngrams_(text.length()) {
+  // the time of the first character isn't valid without the start key.
+  int offset = require_space ? 0 : 1;
+  auto add = [this](int start, int end, int time_start, bool timed) {
+    int id = ngrams_.intern(QStringRef(&text_, start, end - start));
+    int sample = timed ? ngrams_.addSample(id, 0.0, 0.0) : -1;
+    occurrences_.push_back(Occurrence{id, start, end, time_start, sample});
+  };
+
+  occurrences_.reserve(3 * text_.length());
+  for (int i = 0; i < text_.length(); ++i) add(i, i + 1, i, i >= offset);
+  for (int i = 0; i < text_.length() - 2; ++i) add(i, i + 3, i, i >= offset);
+  auto i = wordPattern().globalMatch(text_);
+  while (i.hasNext()) {
+    auto match = i.next();
+    if (match.capturedLength() <= 3) continue;
+    int start = match.capturedStart();
+    add(start, match.capturedEnd(), start == 0 && !require_space ? 1 : start,
+        true);
+  }
+  ngrams_.finish();
+
+  // group the occurrences by their last character, where they're completed.
+  offsets_.assign(text_.length() + 1, 0);
+  for (const auto& o : occurrences_) ++offsets_[o.end];
+  for (int p = 0; p < text_.length(); ++p) offsets_[p + 1] += offsets_[p];
+  vector<Occurrence> grouped(occurrences_.size());
+  vector<int> next(offsets_.begin(), offsets_.end() - 1);
+  char_samples_.assign(text_.length(), -1);
+  for (auto& o : occurrences_) {
+    if (o.sample >= 0) o.sample = ngrams_.slot(o.sample);
+    if (o.end - o.start == 1) char_samples_[o.start] = o.sample;
+    grouped[next[o.end - 1]++] = o;
+  }
+  occurrences_.swap(grouped);
+}
+
+shared_ptr<const TextAnalysis> TextAnalysis::get(int id, const QString& text,
+                                                 bool require_space) {
+  // generated texts have no id and are rarely seen twice.
+  if (id < 0) return make_shared<const TextAnalysis>(text, require_space);
+
+  {
+    QMutexLocker locker(&cache_lock);
+    for (size_t i = 0; i < cache.size(); ++i) {
+      if (cache_ids[i] != id || cache[i]->requireSpace() != require_space)
+        continue;
+      auto analysis = cache[i];
+      cache.erase(cache.begin() + i);
+      cache_ids.erase(cache_ids.begin() + i);
+      // the text could have been edited since.
+      if (analysis->text() != text) break;
+      cache.push_front(analysis);
+      cache_ids.push_front(id);
+      return analysis;
+    }
+  }
+
+  // analyze outside of the lock, another thread might be doing the same text
+  // but the result is identical either way.
+  auto analysis = make_shared<const TextAnalysis>(text, require_space);
+  QMutexLocker locker(&cache_lock);
+  cache.push_front(analysis);
+  cache_ids.push_front(id);
+  if (cache.size() > kCacheSize) {
+    cache.pop_back();
+    cache_ids.pop_back();
+  }
+  return analysis;
+}
+
+const QRegularExpression& TextAnalysis::wordPattern() {
+  static const QRegularExpression re(
+      "((\\w|'(?![A-Z]))+(-\\w(\\w|')*)*)",
+      QRegularExpression::UseUnicodePropertiesOption);
+  return re;
+}
+
+void TextAnalysis::clearCache() {
+  QMutexLocker locker(&cache_lock);
+  cache.clear();
+  cache_ids.clear();
+}
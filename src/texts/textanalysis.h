@@ -0,0 +1,90 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_TEXTS_TEXTANALYSIS_H_
+#define SRC_TEXTS_TEXTANALYSIS_H_
+
+#include <QRegularExpression>
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+#include "quizzer/testresult.h"
+
+using std::shared_ptr;
+using std::vector;
+
+/*! The ngrams of a text and where they occur in it.
+
+  None of it depends on how the text is typed, so it's worked out once per text
+  and shared by every test of it: retries of the same Text reuse it, copies of
+  a Text carry it along and texts loaded again by id find it in a small cache.
+
+  The analysis keeps its own copy of the text that the ngrams point into, so
+  it can't be copied or moved. Tables copied from ngrams() point into it too
+  and have to be outlived by the analysis.
+*/
+class TextAnalysis {
+ public:
+  //! an ngram at a place in the text, with the slot of its sample.
+  struct Occurrence {
+    int ngram;
+    int start;
+    int end;
+    //! where its time starts, the first character has no time.
+    int time_start;
+    //! the sample slot in ngrams(), -1 if it has no time.
+    int sample;
+  };
+
+  TextAnalysis(const QString& text, bool require_space);
+  TextAnalysis(const TextAnalysis&) = delete;
+  TextAnalysis& operator=(const TextAnalysis&) = delete;
+
+  /*! the analysis of `text`, shared with earlier texts with the same id
+    and contents. */
+  static shared_ptr<const TextAnalysis> get(int id, const QString& text,
+                                            bool require_space);
+  //! forget every cached analysis.
+  static void clearCache();
+  //! the words that are ngrams when they're longer than trigrams.
+  static const QRegularExpression& wordPattern();
+
+  const QString& text() const { return text_; }
+  bool requireSpace() const { return require_space_; }
+  //! every ngram of the text, with a zeroed sample for each timed occurrence.
+  const NgramTable& ngrams() const { return ngrams_; }
+  //! ordered by their last character.
+  const vector<Occurrence>& occurrences() const { return occurrences_; }
+  //! the occurrences ending at `position` are [begin, end).
+  int occurrencesBegin(int position) const { return offsets_[position]; }
+  int occurrencesEnd(int position) const { return offsets_[position + 1]; }
+  //! the sample slot of each character, -1 if it has none.
+  const vector<int>& charSamples() const { return char_samples_; }
+
+ private:
+  QString text_;
+  bool require_space_;
+  NgramTable ngrams_;
+  vector<Occurrence> occurrences_;
+  vector<int> offsets_;
+  vector<int> char_samples_;
+};
+
+#endif  // SRC_TEXTS_TEXTANALYSIS_H_
@@ -0,0 +1,124 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "texts/textindex.h"
+
+#include <QMutexLocker>
+#include <QRegularExpression>
+
+#include <algorithm>
+
+#include "texts/textanalysis.h"
+
+namespace {
+// BM25 style saturation of repeated terms, against a text of typical length.
+constexpr double kSaturation = 1.2;
+constexpr double kLengthWeight = 0.75;
+constexpr double kTypicalLength = 300.0;
+
+//! orders a posting heap with the least impact on top.
+bool moreImpact(const TextIndex::Posting& a, const TextIndex::Posting& b) {
+  return a.impact > b.impact;
+}
+}  // namespace
+
+void TextIndex::Builder::add(int id, const QString& text) {
+  counts_.clear();
+  for (int i = 0; i + 3 <= text.length(); ++i) ++counts_[text.mid(i, 3)];
+  auto words = TextAnalysis::wordPattern().globalMatch(text);
+  while (words.hasNext()) {
+    auto match = words.next();
+    if (match.capturedLength() > 3) ++counts_[match.captured()];
+  }
+  texts_.push_back(id);
+  for (auto it = counts_.constBegin(); it != counts_.constEnd(); ++it)
+    post(it.key(), it.value(), text.length());
+}
+
+void TextIndex::Builder::post(const QString& term, int count,
+                              double length) {
+  float impact = static_cast<float>(
+      count * (kSaturation + 1.0) /
+      (count + kSaturation * (1.0 - kLengthWeight +
+                              kLengthWeight * length / kTypicalLength)));
+  auto it = terms_.find(term);
+  if (it == terms_.end()) {
+    it = terms_.insert(term, static_cast<int>(postings_.size()));
+    postings_.emplace_back();
+  }
+  auto& postings = postings_[it.value()];
+  const size_t capacity = kMaxPostings;
+  Posting posting{static_cast<int>(texts_.size()) - 1, impact};
+  if (postings.size() < capacity) {
+    postings.push_back(posting);
+    if (postings.size() == capacity)
+      std::make_heap(postings.begin(), postings.end(), moreImpact);
+  } else if (impact > postings.front().impact) {
+    // replace the posting with the least impact.
+    std::pop_heap(postings.begin(), postings.end(), moreImpact);
+    postings.back() = posting;
+    std::push_heap(postings.begin(), postings.end(), moreImpact);
+  }
+}
+
+void TextIndex::load(Builder&& builder) {
+  for (auto& postings : builder.postings_) postings.shrink_to_fit();
+  QMutexLocker locker(&lock_);
+  terms_.swap(builder.terms_);
+  postings_.swap(builder.postings_);
+  texts_.swap(builder.texts_);
+  loaded_ = true;
+}
+
+void TextIndex::invalidate() {
+  QMutexLocker locker(&lock_);
+  loaded_ = false;
+}
+
+bool TextIndex::loaded() const {
+  QMutexLocker locker(&lock_);
+  return loaded_;
+}
+
+int TextIndex::size() const {
+  QMutexLocker locker(&lock_);
+  return static_cast<int>(texts_.size());
+}
+
+vector<TextIndex::Match> TextIndex::search(
+    const QHash<QString, float>& weights, int k) const {
+  QMutexLocker locker(&lock_);
+  vector<float> scores(texts_.size(), 0.0f);
+  vector<int> scored;
+  for (auto it = weights.constBegin(); it != weights.constEnd(); ++it) {
+    auto term = terms_.constFind(it.key());
+    if (term == terms_.constEnd() || it.value() <= 0.0f) continue;
+    for (const auto& posting : postings_[term.value()]) {
+      if (scores[posting.doc] == 0.0f) scored.push_back(posting.doc);
+      scores[posting.doc] += it.value() * posting.impact;
+    }
+  }
+
+  auto higher = [&scores](int a, int b) { return scores[a] > scores[b]; };
+  auto end = scored.begin() + std::min<size_t>(std::max(0, k), scored.size());
+  std::partial_sort(scored.begin(), end, scored.end(), higher);
+  vector<Match> matches;
+  for (auto doc = scored.begin(); doc != end; ++doc)
+    matches.push_back(Match{texts_[*doc], scores[*doc]});
+  return matches;
+}
@@ -0,0 +1,91 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_TEXTS_TEXTINDEX_H_
+#define SRC_TEXTS_TEXTINDEX_H_
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include <vector>
+
+using std::vector;
+
+/*! An inverted index of the trigrams and words of the texts of a library, to
+  find the texts that cover the most of a set of weighted ngrams.
+
+  Each term keeps the texts it has the most impact in, saturating with how
+  often it's repeated and lower in longer texts, so a search only visits a
+  bounded number of postings per term however big the library is. Like
+  RecentResults it's shared by every Database opened on a profile, built the
+  first time it's needed and built again after the texts change.
+*/
+class TextIndex {
+ public:
+  //! at most this many texts are kept for each term.
+  static constexpr const int kMaxPostings = 1024;
+
+  struct Match {
+    int text;
+    float score;
+  };
+  struct Posting {
+    //! the index of the text in the order it was added.
+    int doc;
+    float impact;
+  };
+
+  //! collects the postings of the texts, outside of the index's lock.
+  class Builder {
+   public:
+    void add(int id, const QString& text);
+
+   private:
+    friend class TextIndex;
+    void post(const QString& term, int count, double length);
+
+    QHash<QString, int> terms_;
+    vector<vector<Posting>> postings_;
+    //! the id of each text.
+    vector<int> texts_;
+    //! the terms of the text being added and how often they occur.
+    QHash<QString, int> counts_;
+  };
+
+  //! replace the index with what `builder` collected.
+  void load(Builder&& builder);
+  //! forget the texts until they're loaded again.
+  void invalidate();
+  bool loaded() const;
+  //! the number of texts indexed.
+  int size() const;
+  /*! the `k` texts that score the highest for `weights` of trigrams and
+    words, best first. Texts score the sum of the weight times the impact
+    of each weighted term in them. */
+  vector<Match> search(const QHash<QString, float>& weights, int k) const;
+
+ private:
+  mutable QMutex lock_;
+  QHash<QString, int> terms_;
+  vector<vector<Posting>> postings_;
+  vector<int> texts_;
+  bool loaded_ = false;
+};
+
+#endif  // SRC_TEXTS_TEXTINDEX_H_
@@ -0,0 +1,192 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "texts/textprefetcher.h"
+
+#include <QMutexLocker>
+
+#include <exception>
+#include <memory>
+
+#include <QsLog.h>
+
+#include "database/db.h"
+
+namespace {
+//! methods that pick texts from the statistics, which change with every
+//! result. no default, so that a new method has to be listed here.
+bool fromStatistics(amphetype::SelectionMethod method) {
+  switch (method) {
+    case amphetype::SelectionMethod::WeakSpots:
+    case amphetype::SelectionMethod::SpacedRepetition:
+    case amphetype::SelectionMethod::SlowWords:
+    case amphetype::SelectionMethod::FastWords:
+    case amphetype::SelectionMethod::ViscousWords:
+    case amphetype::SelectionMethod::FluidWords:
+    case amphetype::SelectionMethod::InaccurateWords:
+    case amphetype::SelectionMethod::AccurateWords:
+    case amphetype::SelectionMethod::DamagingWords:
+      return true;
+    case amphetype::SelectionMethod::None:
+    case amphetype::SelectionMethod::Random:
+    case amphetype::SelectionMethod::InOrder:
+    case amphetype::SelectionMethod::Repeat:
+      return false;
+  }
+  return false;
+}
+
+//! repeats are only copies, there's nothing to select ahead.
+bool prefetchable(amphetype::SelectionMethod method) {
+  return method != amphetype::SelectionMethod::None &&
+         method != amphetype::SelectionMethod::Repeat;
+}
+
+int idOf(const shared_ptr<Text>& text) { return text ? text->id() : -1; }
+}  // namespace
+
+TextPrefetcher::TextPrefetcher(int depth, const QString& profile,
+                               QObject* parent)
+    : QObject(parent), depth_(depth), profile_(profile) {
+  // one at a time, so texts in order are chained in order.
+  pool_.setMaxThreadCount(1);
+}
+
+TextPrefetcher::~TextPrefetcher() {
+  {
+    QMutexLocker locker(&lock_);
+    clear();
+    method_ = amphetype::SelectionMethod::None;
+  }
+  pool_.waitForDone();
+}
+
+shared_ptr<Text> TextPrefetcher::next(amphetype::SelectionMethod method,
+                                      const shared_ptr<Text>& last) {
+  shared_ptr<Text> text;
+  {
+    QMutexLocker locker(&lock_);
+    if (method != method_) {
+      clear();
+      method_ = method;
+    }
+    // texts in order that don't follow `last` were chained from a text that
+    // was skipped.
+    while (!text && !queue_.empty()) {
+      if (method != amphetype::SelectionMethod::InOrder ||
+          queue_.front().after == idOf(last))
+        text = queue_.front().text;
+      queue_.pop_front();
+    }
+  }
+  if (!text) {
+    QLOG_DEBUG() << "TextPrefetcher: no text ready";
+    text = Text::selectText(method, last.get());
+  }
+  prefetch(method, text);
+  return text;
+}
+
+void TextPrefetcher::prefetch(amphetype::SelectionMethod method,
+                              const shared_ptr<Text>& last) {
+  QMutexLocker locker(&lock_);
+  if (method != method_ ||
+      (method == amphetype::SelectionMethod::InOrder && !queue_.empty() &&
+       queue_.front().after != idOf(last))) {
+    clear();
+    method_ = method;
+  }
+  last_ = last;
+  schedule();
+}
+
+int TextPrefetcher::queued() const {
+  QMutexLocker locker(&lock_);
+  return static_cast<int>(queue_.size());
+}
+
+void TextPrefetcher::wait() { pool_.waitForDone(); }
+
+void TextPrefetcher::invalidate() {
+  QMutexLocker locker(&lock_);
+  clear();
+  schedule();
+}
+
+void TextPrefetcher::invalidateStatistics() {
+  QMutexLocker locker(&lock_);
+  if (!fromStatistics(method_)) return;
+  clear();
+  schedule();
+}
+
+void TextPrefetcher::schedule() {
+  if (running_ || !prefetchable(method_) ||
+      static_cast<int>(queue_.size()) >= depth_)
+    return;
+  running_ = true;
+  pool_.start(new TextFetcher(this));
+}
+
+void TextPrefetcher::fill() {
+  std::unique_ptr<Database> db;
+  // the profile may change between texts.
+  quint64 opened = 0;
+  try {
+    while (true) {
+      amphetype::SelectionMethod method;
+      shared_ptr<Text> last;
+      quint64 generation;
+      {
+        QMutexLocker locker(&lock_);
+        if (!prefetchable(method_) ||
+            static_cast<int>(queue_.size()) >= depth_) {
+          running_ = false;
+          return;
+        }
+        method = method_;
+        generation = generation_;
+        last = queue_.empty() ? last_ : queue_.back().text;
+      }
+      if (!db || opened != generation) {
+        db = std::make_unique<Database>(profile_);
+        opened = generation;
+      }
+      auto text = Text::selectText(db.get(), method, last.get());
+      // so the test doesn't have to.
+      text->analysis(false);
+      text->analysis(true);
+      QMutexLocker locker(&lock_);
+      if (generation == generation_) queue_.push_back({idOf(last), text});
+    }
+  } catch (const std::exception& e) {
+    QLOG_ERROR() << "error prefetching texts" << e.what();
+    QMutexLocker locker(&lock_);
+    running_ = false;
+  }
+}
+
+void TextPrefetcher::clear() {
+  queue_.clear();
+  ++generation_;
+}
+
+TextFetcher::TextFetcher(TextPrefetcher* prefetcher)
+    : QRunnable(), prefetcher_(prefetcher) {}
+
+void TextFetcher::run() { prefetcher_->fill(); }
@@ -0,0 +1,107 @@
+// Copyright (C) 2016  Cory Parsons
+//
+// This file is part of amphetype2.
+//
+// amphetype2 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// amphetype2 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with amphetype2.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef SRC_TEXTS_TEXTPREFETCHER_H_
+#define SRC_TEXTS_TEXTPREFETCHER_H_
+
+#include <QMutex>
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+#include <QThreadPool>
+
+#include <deque>
+#include <memory>
+
+#include "defs.h"
+#include "texts/text.h"
+
+using std::shared_ptr;
+
+/*! Selects the next few texts on a worker thread while the current one is
+  typed, so that moving on to the next text doesn't wait for the database.
+
+  The queue holds texts for one SelectionMethod at a time. Texts in order are
+  chained from the last queued one, the others don't depend on the text before
+  them. Texts that aren't ready yet are selected right away.
+*/
+class TextPrefetcher : public QObject {
+  Q_OBJECT
+
+ public:
+  /*! \param depth the number of texts to keep ready.
+    \param profile the profile to select from, the current one if null. */
+  explicit TextPrefetcher(int depth = 2, const QString& profile = QString(),
+                          QObject* parent = Q_NULLPTR);
+  ~TextPrefetcher();
+
+  /*! the text to type after `last` with `method`, and start selecting the
+    ones after it. */
+  shared_ptr<Text> next(amphetype::SelectionMethod method,
+                        const shared_ptr<Text>& last = nullptr);
+  //! start selecting the texts to type after `last` with `method`.
+  void prefetch(amphetype::SelectionMethod method,
+                const shared_ptr<Text>& last);
+  //! the number of texts that are ready.
+  int queued() const;
+  //! block until the queue is filled.
+  void wait();
+
+ public slots:
+  //! drop the queued texts and select them again.
+  void invalidate();
+  //! drop the queued texts if they were selected from the statistics.
+  void invalidateStatistics();
+
+ private:
+  friend class TextFetcher;
+  struct Prefetched {
+    //! the id of the text this one was selected after, for texts in order.
+    int after;
+    shared_ptr<Text> text;
+  };
+
+  //! start a fetcher unless one is running. call with lock_ held.
+  void schedule();
+  //! select texts until the queue is full or invalidated.
+  void fill();
+  void clear();
+
+  const int depth_;
+  const QString profile_;
+  mutable QMutex lock_;
+  amphetype::SelectionMethod method_ = amphetype::SelectionMethod::None;
+  //! the text the queue follows on from.
+  shared_ptr<Text> last_;
+  std::deque<Prefetched> queue_;
+  //! bumped whenever the queue is dropped, to discard texts in flight.
+  quint64 generation_ = 0;
+  bool running_ = false;
+  QThreadPool pool_;
+};
+
+class TextFetcher : public QRunnable {
+ public:
+  explicit TextFetcher(TextPrefetcher* prefetcher);
+  void run() override;
+
+ private:
+  TextPrefetcher* prefetcher_;
+};
+
+#endif  // SRC_TEXTS_TEXTPREFETCHER_H_
@@ -0,0 +1,120 @@
+#include <QObject>
+#include <QString>
+#include <QtTest>
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include "quizzer/test.h"
+#include "texts/text.h"
+
+using std::make_shared;
+
+// Every allocation made by the test thread while `counting` is set is
+// counted. Qt allocates its containers with malloc, so on glibc that is hooked
+// as well as operator new.
+namespace {
+thread_local bool counting = false;
+thread_local int allocations = 0;
+
+void count() {
+  if (counting) ++allocations;
+}
+}  // namespace
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size) {
+  count();
+  return __libc_malloc(size);
+}
+void* calloc(size_t n, size_t size) {
+  count();
+  return __libc_calloc(n, size);
+}
+void* realloc(void* p, size_t size) {
+  count();
+  return __libc_realloc(p, size);
+}
+void free(void* p) { __libc_free(p); }
+}
+#endif
+
+void* operator new(std::size_t size) {
+#if !defined(__GLIBC__)
+  count();
+#endif
+  void* p = std::malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+
+class AllocationTests : public QObject {
+  Q_OBJECT
+ private slots:
+  void testCounting();
+  void testKeystrokes();
+};
+
+void AllocationTests::testCounting() {
+  counting = true;
+  allocations = 0;
+  auto p = new int(1);
+  counting = false;
+  delete p;
+  QCOMPARE(allocations, 1);
+#if defined(__GLIBC__)
+  counting = true;
+  allocations = 0;
+  QString s(1000, 'a');
+  counting = false;
+  QCOMPARE(allocations, 1);
+#endif
+}
+
+void AllocationTests::testKeystrokes() {
+  const int kKeystrokes = 10000;
+  auto text = make_shared<Text>(
+      QString("The quick brown fox jumps over the lazy dog. ").repeated(250));
+  Test test(text);
+  const QString& passage = text->text();
+  qint64 ns = 0;
+  auto key = [&test, &ns](Keystroke::Type type, QChar c, int position) {
+    int code = type == Keystroke::Type::Erase ? Qt::Key_Backspace : c.unicode();
+    test.handleKeystroke(Keystroke{type, c, position, ns += 50000000, code});
+    test.handleKeystroke(
+        Keystroke{Keystroke::Type::Release, QChar(), 0, ns += 50000000, code});
+  };
+  key(Keystroke::Type::Insert, passage[0], 0);
+  QVERIFY(test.started());
+
+  counting = true;
+  allocations = 0;
+  int position = 1;
+  for (int i = 1; i < kKeystrokes; ++position) {
+    if (position % 97 == 0) {  // a mistake and its correction
+      key(Keystroke::Type::Insert, 'x', position);
+      key(Keystroke::Type::Erase, QChar(), position);
+      i += 2;
+    }
+    key(Keystroke::Type::Insert, passage[position], position);
+    ++i;
+  }
+  counting = false;
+
+  QCOMPARE(allocations, 0);
+  QVERIFY(position < passage.length());
+  QVERIFY(!test.finished());
+}
+
+QTEST_MAIN(AllocationTests)
+#include "test_allocation.moc"
@@ -1,13 +1,22 @@
+#include <QDateTime>
 #include <QStandardPaths>
 #include <QString>
+#include <QTemporaryDir>
 #include <QtTest>
 
 #include <cmath>
+#include <memory>
 
 #include <sqlite3.h>
 #include <sqlite3pp.h>
 
 #include "database/db.h"
+#include "database/migrations.h"
+#include "database/recentresults.h"
+#include "database/resultranks.h"
+#include "database/reviewschedule.h"
+#include "texts/textindex.h"
+#include "texts/textprefetcher.h"
 
 class DatabaseTests : public QObject {
   Q_OBJECT
@@ -17,9 +26,20 @@ class DatabaseTests : public QObject {
   void testGetSourcesData();
   void testMedianFunction();
   void testPowFunction();
+  void testMigrateLegacyProfile();
+  void testArchive();
+  void testDeleteSourceInChunks();
+  void testMergeProfile();
+  void testRecentResults();
+  void testResultRanks();
+  void testReviewSchedule();
+  void testTextPrefetcher();
+  void testTextIndex();
   void cleanupTestCase();
 
  private:
+  //! the schema and some data as written before schema versioning.
+  void createLegacyProfile(Database* db);
   Database* db_;
 };
 
@@ -93,6 +113,525 @@ void DatabaseTests::testPowFunction() {
   }
 }
 
+void DatabaseTests::createLegacyProfile(Database* db) {
+  db->bindAndRun(
+      "CREATE TABLE source(id INTEGER PRIMARY KEY, name TEXT, "
+      "disabled INTEGER, discount INTEGER, type INTEGER, text_count INTEGER)");
+  db->bindAndRun(
+      "CREATE TABLE text(id INTEGER PRIMARY KEY, "
+      "source INTEGER REFERENCES source(id) ON DELETE CASCADE, text TEXT, "
+      "disabled INTEGER)");
+  db->bindAndRun(
+      "CREATE TABLE result(id INTEGER PRIMARY KEY, w DATETIME, "
+      "text_id INTEGER REFERENCES text(id) ON DELETE CASCADE, "
+      "source INTEGER REFERENCES source(id), wpm REAL, accuracy REAL, "
+      "viscosity REAL)");
+  db->bindAndRun(
+      "CREATE TABLE statistic(w DATETIME, data TEXT, type INTEGER, "
+      "time REAL, count INTEGER, mistakes INTEGER, viscosity REAL)");
+  db->bindAndRun(
+      "CREATE TABLE mistake(w DATETIME, target TEXT, mistake TEXT, "
+      "count INTEGER)");
+  db->bindAndRun(
+      "CREATE TRIGGER text_count_add_trigger BEFORE INSERT ON text "
+      "FOR EACH ROW BEGIN UPDATE source set text_count = text_count + 1 "
+      "where id = NEW.source; END;");
+  db->bindAndRun(
+      "CREATE TRIGGER text_count_subtract_trigger BEFORE DELETE ON text "
+      "FOR EACH ROW BEGIN UPDATE source set text_count = text_count - 1 "
+      "where id = OLD.source; END;");
+
+  db->bindAndRun("INSERT INTO source VALUES (1, 'legacy', NULL, NULL, 0, 0)");
+  db->bindAndRun("INSERT INTO text VALUES (1, 1, 'the quick brown fox', NULL)");
+  db->bindAndRun(
+      "INSERT INTO result VALUES (1, '2016-01-01T00:00:00', 1, 1, 60.0, "
+      "1.0, 1.5)");
+  const char* stats[] = {"t", "he ", "quick"};
+  for (int i = 0; i < 3; ++i) {
+    db->bindAndRun(
+        "INSERT INTO statistic VALUES ('2016-01-01T00:00:00', ?, ?, 0.2, 2, "
+        "1, 1.0)",
+        db_row{QString(stats[i]), i});
+  }
+  db->bindAndRun(
+      "INSERT INTO mistake VALUES ('2016-01-01T00:00:00', 'q', 'w', 1)");
+}
+
+void DatabaseTests::testMigrateLegacyProfile() {
+  Database db(":memory:");
+  createLegacyProfile(&db);
+  QCOMPARE(db.schemaVersion(), 0);
+
+  // the quick migrations are applied, the rest is left for a Migrator.
+  QVERIFY(!db.initDB());
+  QVERIFY(db.schemaVersion() > 0);
+  QVERIFY(db.schemaVersion() < migrations::latestVersion());
+
+  QVERIFY(db.migrate());
+  QCOMPARE(db.schemaVersion(), migrations::latestVersion());
+  // migrating an up to date profile does nothing.
+  QVERIFY(db.initDB());
+  QCOMPARE(db.schemaVersion(), migrations::latestVersion());
+
+  QCOMPARE(db.getTextsCount(1), 1);
+  QCOMPARE(db.getSourceData(1)[3].toInt(), 1);
+  QCOMPARE(db.getRows("SELECT * FROM mistake").size(), size_t(1));
+  auto keys = db.getStatisticsData(
+      "2000-01-01", amphetype::statistics::Type::Keys, 0,
+      amphetype::statistics::Order::Slow, 10);
+  QCOMPARE(keys.size(), size_t(1));
+  QCOMPARE(keys[0][0].toString(), QString("t"));
+  // every statistic row refers to its ngram by id.
+  QCOMPARE(db.getRows("SELECT * FROM ngram").size(), size_t(3));
+  QCOMPARE(db.getRows("SELECT * FROM statisticView").size(), size_t(3));
+}
+
+void DatabaseTests::testArchive() {
+  Database db(":memory:");
+  QVERIFY(db.initDB());
+  int source = db.getSource("archived source");
+  db.addText(source, "some text");
+  db.bindAndRun("INSERT INTO ngram VALUES (1, 'a', 0, 1)");
+  QString old = QDateTime::currentDateTime().addDays(-100).toString(
+      Qt::ISODate);
+  QString recent = QDateTime::currentDateTime().toString(Qt::ISODate);
+  for (const auto& w : {old, old, recent}) {
+    db.bindAndRun("INSERT INTO result VALUES (NULL, ?, 1, ?, 60, 100, 1)",
+                  db_row{w, source});
+    db.bindAndRun(
+        "INSERT INTO statistic (w, ngram, time, count, mistakes, viscosity) "
+        "VALUES (?, 1, 0.1, 2, 1, 1)",
+        w);
+    db.bindAndRun(
+        "INSERT INTO mistake (w, target, mistake, count) "
+        "VALUES (?, 'a', 's', 1)",
+        w);
+  }
+
+  db.archive(30);
+
+  // the hot tables only keep recent data.
+  QCOMPARE(db.getRows("SELECT * FROM main.result").size(), size_t(1));
+  QCOMPARE(db.getRows("SELECT * FROM main.statistic").size(), size_t(1));
+  QCOMPARE(db.getRows("SELECT * FROM main.mistake").size(), size_t(1));
+  QCOMPARE(db.getRows("SELECT * FROM archive.result").size(), size_t(2));
+  QCOMPARE(db.getRows("SELECT * FROM archive.statistic").size(), size_t(2));
+  // the old statistics of a day are rolled up into one row.
+  QCOMPARE(db.getRows("SELECT * FROM statistic_rollup").size(), size_t(1));
+  auto totals = db.getOneRow("SELECT sum(count) FROM statisticView");
+  QCOMPARE(totals[0].toInt(), 6);
+  // results are still counted from the archive.
+  QCOMPARE(db.getSourceData(source)[3].toInt(), 3);
+  QCOMPARE(db.recentResults()->count(10), 3);
+  QCOMPARE(db.getMedianStats(5).first, 60.0);
+
+  // archiving again doesn't count anything twice.
+  db.archive(30);
+  QCOMPARE(db.getRows("SELECT * FROM archive.result").size(), size_t(2));
+  totals = db.getOneRow("SELECT sum(count) FROM statisticView");
+  QCOMPARE(totals[0].toInt(), 6);
+
+  // ids aren't reused once every result was archived.
+  db.archive(-1);
+  QCOMPARE(db.getRows("SELECT * FROM main.result").size(), size_t(0));
+  db.bindAndRun("INSERT INTO result VALUES (NULL, ?, 1, ?, 60, 100, 1)",
+                db_row{recent, source});
+  QCOMPARE(db.getOneRow("SELECT id FROM main.result")[0].toInt(), 4);
+  db.archive(-1);
+  QCOMPARE(db.getRows("SELECT * FROM archive.result").size(), size_t(4));
+  QCOMPARE(db.getRows("SELECT * FROM main.result").size(), size_t(0));
+
+  // archived results can be deleted like the others.
+  db.deleteResult("1", old);
+  QCOMPARE(db.getRows("SELECT * FROM archive.result").size(), size_t(2));
+  // and so can archived statistics.
+  db.deleteStatistic("a");
+  QCOMPARE(db.getRows("SELECT * FROM archive.statistic").size(), size_t(0));
+  QCOMPARE(db.getRows("SELECT * FROM statistic_rollup").size(), size_t(0));
+}
+
+void DatabaseTests::testDeleteSourceInChunks() {
+  Database db(":memory:");
+  QVERIFY(db.initDB());
+  int source = db.getSource("big source");
+  int other = db.getSource("other source");
+  QStringList texts;
+  for (int i = 0; i < 1200; ++i) texts << QString("text %1").arg(i);
+  db.addTexts(source, texts);
+  db.addText(other, "kept");
+  db.bindAndRun("INSERT INTO result VALUES (NULL, '2016-01-01', 1, ?, 1, 1, 1)",
+                source);
+
+  db.hideSources(QList<int>() << source);
+  QCOMPARE(db.getSourcesData().size(), size_t(1));
+  QCOMPARE(db.hiddenSources(), QList<int>() << source);
+
+  QList<int> progress;
+  db.deleteSource(QList<int>() << source,
+                  [&progress](int percent) { progress << percent; });
+  QVERIFY(progress.size() > 1);
+  QCOMPARE(progress.last(), 100);
+  QCOMPARE(db.getTextsCount(source), 0);
+  QCOMPARE(db.getRows("SELECT * FROM result").size(), size_t(0));
+  QVERIFY(db.hiddenSources().isEmpty());
+  QCOMPARE(db.getTextsCount(other), 1);
+  QCOMPARE(db.getSourceData(other)[2].toInt(), 1);
+  QVERIFY(db.getOneRow("SELECT sql FROM sqlite_master "
+                       "WHERE name = 'text_count_subtract_trigger'")[0]
+              .toString()
+              .indexOf("WHEN") < 0);
+  // a source is shown as disabled when its texts are.
+  QVERIFY(db.getSourceData(other)[5].toString().isEmpty());
+  db.disableSource(QList<int>() << other);
+  QCOMPARE(db.getSourceData(other)[5].toString(), QString("yes"));
+  db.enableSource(QList<int>() << other);
+  // the text count trigger is back for other deletes.
+  auto kept = db.getOneRow("SELECT id FROM text WHERE source = ?", other);
+  db.deleteText(QList<int>() << kept[0].toInt());
+  QCOMPARE(db.getSourceData(other)[2].toInt(), 0);
+}
+
+void DatabaseTests::testMergeProfile() {
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  QString otherPath = dir.path() + "/other.profile";
+  Database db(dir.path() + "/main.profile");
+  QVERIFY(db.initDB());
+  {
+    Database other(otherPath);
+    QVERIFY(other.initDB());
+    other.getSource("unrelated");
+    int source = other.getSource("shared");
+    other.addTexts(source, QStringList() << "one" << "two" << "three");
+    other.bindAndRun(
+        "INSERT INTO result VALUES (NULL, '2016-01-01', 2, ?, 60, 1, 1)",
+        source);
+    other.bindAndRun("INSERT INTO ngram VALUES (1, 'o', 0, 1)");
+    other.bindAndRun(
+        "INSERT INTO statistic VALUES ('2016-01-01', 1, 0.1, 1, 0, 1, 1)");
+    other.bindAndRun(
+        "INSERT INTO mistake VALUES ('2016-01-01', 'o', 'p', 1, 1)");
+    other.bindAndRun("INSERT INTO keystroke_log VALUES (1, x'01')");
+    other.bindAndRun(
+        "INSERT INTO review VALUES (1, '2016-01-02', 1, 2.5, 1, 0)");
+  }
+  int source = db.getSource("shared");
+  db.addTexts(source, QStringList() << "one" << "four");
+  // the merged result gets a different id in this profile.
+  db.bindAndRun(
+      "INSERT INTO result VALUES (NULL, '2015-01-01', 1, ?, 50, 1, 1)",
+      source);
+
+  QVERIFY(db.mergeProfile(otherPath));
+  QCOMPARE(db.getSourcesData().size(), size_t(2));
+  QCOMPARE(db.getTextsCount(source), 4);
+  QCOMPARE(db.getSourceData(source)[2].toInt(), 4);
+  // the result points to the text it was typed on in this profile.
+  auto result = db.getOneRow("SELECT text.text, result.id FROM result "
+                             "JOIN text ON (result.text_id = text.id) "
+                             "WHERE result.w = '2016-01-01'");
+  QCOMPARE(result[0].toString(), QString("two"));
+  QCOMPARE(result[1].toInt(), 2);
+  QCOMPARE(db.getRows("SELECT * FROM statisticView").size(), size_t(1));
+  QCOMPARE(db.getRows("SELECT * FROM mistake").size(), size_t(1));
+  // its keystroke log, statistics and mistakes follow it.
+  QCOMPARE(db.getOneRow("SELECT result_id FROM keystroke_log")[0].toInt(), 2);
+  QCOMPARE(db.getOneRow("SELECT result_id FROM statistic")[0].toInt(), 2);
+  QCOMPARE(db.getOneRow("SELECT result_id FROM mistake")[0].toInt(), 2);
+  QCOMPARE(db.getRows("SELECT * FROM review").size(), size_t(1));
+
+  // merging again changes nothing.
+  QVERIFY(db.mergeProfile(otherPath));
+  QCOMPARE(db.getSourcesData().size(), size_t(2));
+  QCOMPARE(db.getTextsCount(source), 4);
+  QCOMPARE(db.getRows("SELECT * FROM result").size(), size_t(2));
+  QCOMPARE(db.getRows("SELECT * FROM statisticView").size(), size_t(1));
+  QCOMPARE(db.getRows("SELECT * FROM mistake").size(), size_t(1));
+  QCOMPARE(db.getRows("SELECT * FROM keystroke_log").size(), size_t(1));
+  QCOMPARE(db.getRows("SELECT * FROM review").size(), size_t(1));
+}
+
+void DatabaseTests::testRecentResults() {
+  RollingWindow window(3, 100.0, 0.1);
+  for (double wpm : {10.0, 50.0, 20.0}) window.add(wpm);
+  QCOMPARE(window.median(), 20.0);
+  window.add(90.0);  // 10 falls out of the window
+  QCOMPARE(window.count(), 3);
+  QCOMPARE(window.median(), 50.0);
+  QCOMPARE(window.percentile(0.0), 20.0);
+  QCOMPARE(window.percentile(0.5), 50.0);
+  QCOMPARE(window.percentile(1.0), 90.0);
+  window.add(500.0);
+  QCOMPARE(window.percentile(1.0), 100.0);
+  window.add(12.34);
+  QCOMPARE(window.percentile(0.0), 12.3);
+
+  Database db(":memory:");
+  db.initDB();
+  QDateTime start(QDate(2016, 1, 1), QTime(0, 0));
+  for (int i = 0; i < 30; ++i) {
+    db.bindAndRun("INSERT INTO result VALUES (NULL, ?, 1, 1, ?, 0.9, 1)",
+                  db_row{start.addSecs(i).toString(Qt::ISODate), 10.0 + i});
+  }
+  // only the last 10 results, 30 to 39 wpm.
+  auto stats = db.getMedianStats(10);
+  QCOMPARE(stats.first, 34.5);
+  QCOMPARE(stats.second, 90.0);
+  // a window that isn't kept is worked out by the db.
+  QCOMPARE(db.getMedianStats(5).first, 37.0);
+  auto recent = db.recentResults();
+  QCOMPARE(recent->count(100), 30);
+  QCOMPARE(recent->median(RecentResults::Wpm, 100), 24.5);
+
+  TestResult result(std::make_shared<Text>("abc"), start.addDays(1), 100.0,
+                    1.0, 0.0, NgramTable(), {}, {}, QByteArray());
+  db.addResult(&result);
+  QCOMPARE(db.getMedianStats(10).first, 35.5);
+  QCOMPARE(recent->percentile(RecentResults::Wpm, 10, 1.0), 100.0);
+
+  auto id = db.getOneRow("SELECT max(id) FROM result")[0].toInt();
+  db.deleteResult(QList<int>() << id);
+  QVERIFY(!recent->loaded());
+  QCOMPARE(db.getMedianStats(10).first, 34.5);
+
+  // results saved while the windows are read are added once they're
+  // loaded, unless they were read too.
+  recent->invalidate();
+  auto generation = recent->beginLoad();
+  recent->add(50.0, 90.0, 1.0);
+  recent->add(60.0, 90.0, 1.0);
+  QVERIFY(!recent->loaded());
+  recent->load({{{40.0, 90.0, 1.0}}, {{50.0, 90.0, 1.0}}}, generation);
+  QCOMPARE(recent->count(10), 3);
+  QCOMPARE(recent->median(RecentResults::Wpm, 10), 50.0);
+  // a load that started before the results changed is dropped.
+  recent->invalidate();
+  generation = recent->beginLoad();
+  recent->invalidate();
+  recent->load({{{40.0, 90.0, 1.0}}}, generation);
+  QVERIFY(!recent->loaded());
+}
+
+void DatabaseTests::testResultRanks() {
+  using Scope = ResultRanks::Scope;
+  Database db(":memory:");
+  db.initDB();
+  QDateTime start(QDate(2016, 1, 1), QTime(0, 0));
+  // 10 to 29 wpm, alternating between text 1 of source 1 and text 2 of
+  // source 2.
+  for (int i = 0; i < 20; ++i) {
+    db.bindAndRun("INSERT INTO result VALUES (NULL, ?, ?, ?, ?, 0.9, ?)",
+                  db_row{start.addSecs(i).toString(Qt::ISODate), 1 + i % 2,
+                         1 + i % 2, 10.0 + i, 5.0 + i});
+  }
+  auto ranks = db.resultRanks();
+  QCOMPARE(ranks->count(), 20);
+  QCOMPARE(ranks->count(Scope::Text, 2), 10);
+  QCOMPARE(ranks->count(Scope::Text, 3), 0);
+  QCOMPARE(ranks->best(RecentResults::Wpm), 29.0);
+  QCOMPARE(ranks->worst(RecentResults::Wpm), 10.0);
+  QCOMPARE(ranks->best(RecentResults::Wpm, Scope::Source, 1), 28.0);
+  QCOMPARE(ranks->worst(RecentResults::Wpm, Scope::Text, 2), 11.0);
+  // lower viscosity is better.
+  QCOMPARE(ranks->best(RecentResults::Viscosity), 5.0);
+  QCOMPARE(ranks->rank(RecentResults::Viscosity, 6.0).better, 1);
+  QCOMPARE(ranks->best(RecentResults::Accuracy), 90.0);
+
+  auto rank = ranks->rank(RecentResults::Wpm, 28.0);
+  QCOMPARE(rank.better, 1);
+  QCOMPARE(rank.count, 20);
+  QCOMPARE(rank.top(), 0.05);
+  QCOMPARE(ranks->rank(RecentResults::Wpm, 28.0, Scope::Text, 1).better, 0);
+  QCOMPARE(ranks->rank(RecentResults::Wpm, 28.0, Scope::Text, 2).better, 1);
+  QCOMPARE(ranks->rank(RecentResults::Wpm, 100.0).better, 0);
+
+  ResultRanks::Extreme worst, best;
+  QVERIFY(ranks->wpmRange(&worst, &best));
+  QCOMPARE(worst.wpm, 10.0);
+  QCOMPARE(worst.when, start);
+  QCOMPARE(best.wpm, 29.0);
+  QCOMPARE(best.when, start.addSecs(19));
+
+  // saved results are ranked without a reload.
+  TestResult result(std::make_shared<Text>("abc", 3, 1), start.addDays(1),
+                    50.0, 1.0, 0.0, NgramTable(), {}, {}, QByteArray());
+  db.addResult(&result);
+  QVERIFY(ranks->loaded());
+  QCOMPARE(ranks->count(), 21);
+  QCOMPARE(ranks->count(Scope::Text, 3), 1);
+  QCOMPARE(ranks->best(RecentResults::Wpm, Scope::Source, 1), 50.0);
+  QVERIFY(ranks->wpmRange(&worst, &best));
+  QCOMPARE(best.when, start.addDays(1));
+
+  // and deleted ones with one.
+  auto id = db.getOneRow("SELECT max(id) FROM result")[0].toInt();
+  db.deleteResult(QList<int>() << id);
+  QVERIFY(!ranks->loaded());
+  QCOMPARE(db.resultRanks()->best(RecentResults::Wpm), 29.0);
+
+  // results saved while the ranks are read are added once they're loaded,
+  // unless they were read too.
+  ranks->invalidate();
+  auto generation = ranks->beginLoad();
+  ResultRanks::Entry read{start, 1, 1, {{10.0, 90.0, 5.0}}};
+  ResultRanks::Entry late{start.addDays(2), 1, 1, {{60.0, 90.0, 5.0}}};
+  ranks->add(read);
+  ranks->add(late);
+  QVERIFY(!ranks->loaded());
+  ranks->load({read}, generation);
+  QVERIFY(ranks->loaded());
+  QCOMPARE(ranks->count(), 2);
+  QCOMPARE(ranks->best(RecentResults::Wpm), 60.0);
+  // a load that started before the results changed is dropped.
+  ranks->invalidate();
+  generation = ranks->beginLoad();
+  ranks->invalidate();
+  ranks->load({read}, generation);
+  QVERIFY(!ranks->loaded());
+}
+
+void DatabaseTests::testReviewSchedule() {
+  QCOMPARE(ReviewSchedule::quality(1, 100.0, 50.0), 1);
+  QCOMPARE(ReviewSchedule::quality(0, 30.0, 50.0), 2);
+  QCOMPARE(ReviewSchedule::quality(0, 40.0, 50.0), 3);
+  QCOMPARE(ReviewSchedule::quality(0, 45.0, 50.0), 4);
+  QCOMPARE(ReviewSchedule::quality(0, 60.0, 50.0), 5);
+
+  const qint64 day = 24 * 60 * 60;
+  auto review = ReviewSchedule::grade(Review(), 5, 0);
+  QCOMPARE(review.reps, 1);
+  QCOMPARE(review.due, day);
+  QCOMPARE(review.ease, 2.6);
+  review = ReviewSchedule::grade(review, 4, day);
+  QCOMPARE(review.due, 7 * day);
+  review = ReviewSchedule::grade(review, 4, 7 * day);
+  QCOMPARE(review.interval, 6 * 2.6);
+  // a lapse starts over in a few minutes and eases the interval.
+  review = ReviewSchedule::grade(review, 1, 10 * day);
+  QCOMPARE(review.reps, 0);
+  QCOMPARE(review.lapses, 1);
+  QCOMPARE(review.due, 10 * day + 600);
+  QVERIFY(review.ease < 2.6);
+
+  auto due = [](qint64 when) {
+    Review review;
+    review.due = when;
+    return review;
+  };
+  ReviewSchedule schedule;
+  schedule.update({{1, "one", due(300)}});
+  QCOMPARE(schedule.size(), 0);
+  schedule.load({{1, "one", due(300)}, {2, "two", due(100)},
+                 {3, "three", due(200)}});
+  QCOMPARE(schedule.next(2, 1000), QStringList() << "two"
+                                                 << "three");
+  // picking doesn't take them off the schedule.
+  QCOMPARE(schedule.next(2, 1000), QStringList() << "two"
+                                                 << "three");
+  schedule.update({{1, "one", due(50)}, {2, "two", due(400)}});
+  QCOMPARE(schedule.next(5, 1000), QStringList() << "one"
+                                                 << "three"
+                                                 << "two");
+  // ngrams that aren't due yet are left for later.
+  QCOMPARE(schedule.next(5, 250), QStringList() << "one"
+                                                << "three");
+  QVERIFY(schedule.next(5, 10).isEmpty());
+  QCOMPARE(schedule.next(5, 1000).size(), 3);
+  Review found;
+  QVERIFY(schedule.find(2, &found));
+  QCOMPARE(found.due, qint64(400));
+  QVERIFY(!schedule.find(4, &found));
+}
+
+void DatabaseTests::testTextPrefetcher() {
+  using amphetype::SelectionMethod;
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  QString path = dir.path() + "/prefetch.profile";
+  Database db(path);
+  QVERIFY(db.initDB());
+  int source = db.getSource("in order");
+  db.addTexts(source, QStringList() << "one" << "two" << "three" << "four");
+
+  TextPrefetcher prefetcher(2, path);
+  auto one = db.getText(1);
+  prefetcher.prefetch(SelectionMethod::InOrder, one);
+  prefetcher.wait();
+  QCOMPARE(prefetcher.queued(), 2);
+  auto two = prefetcher.next(SelectionMethod::InOrder, one);
+  QCOMPARE(two->text(), QString("two"));
+  prefetcher.wait();
+  QCOMPARE(prefetcher.queued(), 2);
+  QCOMPARE(prefetcher.next(SelectionMethod::InOrder, two)->text(),
+           QString("three"));
+
+  // a text picked out of order starts a new chain.
+  prefetcher.wait();
+  QCOMPARE(prefetcher.next(SelectionMethod::InOrder, one)->text(),
+           QString("two"));
+
+  // queued texts are selected again when the texts change.
+  prefetcher.wait();
+  db.updateText(3, "changed");
+  prefetcher.invalidate();
+  prefetcher.wait();
+  QCOMPARE(prefetcher.next(SelectionMethod::InOrder, two)->text(),
+           QString("changed"));
+
+  // repeats aren't selected ahead.
+  prefetcher.prefetch(SelectionMethod::Repeat, two);
+  prefetcher.wait();
+  QCOMPARE(prefetcher.queued(), 0);
+  QCOMPARE(prefetcher.next(SelectionMethod::Repeat, two)->text(),
+           QString("two"));
+}
+
+void DatabaseTests::testTextIndex() {
+  TextIndex index;
+  QVERIFY(!index.loaded());
+  TextIndex::Builder builder;
+  builder.add(10, "the quick brown fox");
+  builder.add(11, "quick quick quick");
+  builder.add(12, "jumps over the lazy dog");
+  index.load(std::move(builder));
+  QVERIFY(index.loaded());
+  QCOMPARE(index.size(), 3);
+
+  // words and trigrams are both terms, repeats count for more.
+  auto matches = index.search({{"quick", 1.0f}}, 5);
+  QCOMPARE(static_cast<int>(matches.size()), 2);
+  QCOMPARE(matches[0].text, 11);
+  QCOMPARE(matches[1].text, 10);
+  // the text covering the most weak spots wins.
+  matches = index.search({{"the", 1.0f}, {"azy", 1.0f}, {"fox", 0.5f}}, 1);
+  QCOMPARE(static_cast<int>(matches.size()), 1);
+  QCOMPARE(matches[0].text, 12);
+  QVERIFY(index.search({{"cat", 1.0f}}, 5).empty());
+
+  // a term keeps the texts it has the most impact in.
+  TextIndex big;
+  for (int i = 0; i < TextIndex::kMaxPostings + 10; ++i) {
+    builder.add(i, i == 5 ? QString("zzz") : QString("zzz ") + QString(i, 'a'));
+  }
+  big.load(std::move(builder));
+  matches = big.search({{"zzz", 1.0f}}, TextIndex::kMaxPostings + 10);
+  QCOMPARE(static_cast<int>(matches.size()), int(TextIndex::kMaxPostings));
+  QCOMPARE(matches[0].text, 5);
+
+  // the library is indexed when it's first needed and after it changes.
+  Database db(":memory:");
+  db.initDB();
+  int source = db.getSource("indexed");
+  db.addTexts(source, QStringList() << "alpha beta" << "gamma delta");
+  auto texts = db.textIndex();
+  QCOMPARE(texts->size(), 2);
+  db.addText(source, "epsilon");
+  QVERIFY(!texts->loaded());
+  QCOMPARE(db.textIndex()->size(), 3);
+  matches = texts->search({{"gamma", 1.0f}}, 1);
+  QCOMPARE(db.getText(matches[0].text)->text(), QString("gamma delta"));
+}
+
 void DatabaseTests::cleanupTestCase() { delete db_; }
 
 QTEST_MAIN(DatabaseTests)
@@ -10,10 +10,21 @@
 #include <utility>
 #include <set>
 #include <array>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
 
 #include "database/db.h"
+#include "quizzer/keystrokelog.h"
+#include "quizzer/latencytrace.h"
+#include "quizzer/replay.h"
+#include "quizzer/spscring.h"
 #include "quizzer/test.h"
 #include "quizzer/testresult.h"
+#include "quizzer/testrunner.h"
+#include "texts/textanalysis.h"
 
 using std::shared_ptr;
 using std::make_shared;
@@ -28,8 +39,779 @@ class TestTests : public QObject {
   void testStatistics_data();
   void testViscosity();
   void testRequireSpace();
+  void testInputMatcher();
+  void testNgramTable();
+  void testTextAnalysis();
+  void testKeystrokes();
+  void testRetypedStatistics();
+  void testKeystrokeLog();
+  void testKeystrokeLogSize();
+  void testKeyTimings();
+  void testReplay();
+  void testSpscRing();
+  void testRunnerWakeup();
+  void testLatencyHistogram();
+  void benchmarkTyping();
+  void benchmarkTyping_data();
+  void testSaveResult();
+  void testReviews();
+  void testTextStatistics();
+  void benchmarkTextStatistics();
+  void benchmarkFinish();
+  void benchmarkFinish_data();
 };
 
+void TestTests::testInputMatcher() {
+  InputMatcher matcher("abcdef");
+  matcher.edit(0, 0, "ab");
+  QCOMPARE(matcher.correct(), 2);
+  QCOMPARE(matcher.errors(), 0);
+  matcher.edit(2, 0, "x");
+  matcher.edit(3, 0, "d");
+  QCOMPARE(matcher.correct(), 2);
+  QCOMPARE(matcher.errors(), 2);
+  // backspace over the mistake and correct it.
+  matcher.edit(3, 1, "");
+  matcher.edit(2, 1, "");
+  matcher.edit(2, 0, "cd");
+  QCOMPARE(matcher.correct(), 4);
+  QCOMPARE(matcher.errors(), 0);
+  // an edit before the end of the correct prefix.
+  matcher.edit(1, 1, "z");
+  QCOMPARE(matcher.correct(), 1);
+  matcher.reset("abcdef");
+  QVERIFY(matcher.complete());
+  QCOMPARE(Test::last_equal_position("abcx", "abcdef"), 2);
+  QCOMPARE(Test::last_equal_position("", "abc"), -1);
+}
+
+void TestTests::testNgramTable() {
+  QString text("abab");
+  NgramTable table;
+  int ab = table.intern(QStringRef(&text, 0, 2));
+  int b = table.intern(QStringRef(&text, 1, 1));
+  QCOMPARE(table.intern(QStringRef(&text, 2, 2)), ab);
+  QCOMPARE(table.find(QStringRef(&text, 3, 1)), b);
+  QCOMPARE(table.find(QStringRef(&text, 1, 2)), -1);
+  table.addSample(ab, 1.0, 10.0);
+  table.addSample(b, 2.0, 20.0);
+  table.addSample(ab, 3.0, 30.0);
+  table.addMistakes(b, 2);
+  table.finish();
+
+  QCOMPARE(table.size(), 2);
+  QCOMPARE(table.ngram(ab).toString(), QString("ab"));
+  QCOMPARE(table.count(ab), 2);
+  QCOMPARE(table.times(ab)[0], 1.0);
+  QCOMPARE(table.times(ab)[1], 3.0);
+  QCOMPARE(table.viscosities(ab)[1], 30.0);
+  QCOMPARE(table.count(b), 1);
+  QCOMPARE(table.times(b)[0], 2.0);
+  QCOMPARE(table.mistakes(ab), 0);
+  QCOMPARE(table.mistakes(b), 2);
+}
+
+void TestTests::testTextAnalysis() {
+  TextAnalysis::clearCache();
+  auto text = make_shared<Text>("the quick fox", 7);
+  auto analysis = text->analysis(false);
+  const auto& ngrams = analysis->ngrams();
+  // "quick" is the only word longer than 3 characters.
+  int quick = ngrams.find(QStringRef(&analysis->text(), 4, 5));
+  QVERIFY(quick >= 0);
+  QCOMPARE(ngrams.count(quick), 1);
+  // the first character and trigram have no time without the start key.
+  QCOMPARE(analysis->charSamples()[0], -1);
+  QVERIFY(analysis->charSamples()[1] >= 0);
+  QCOMPARE(ngrams.count(ngrams.find(QStringRef(&analysis->text(), 0, 3))), 0);
+  QVERIFY(text->analysis(true)->charSamples()[0] >= 0);
+  for (int p = 0; p < text->text().length(); ++p) {
+    for (int i = analysis->occurrencesBegin(p); i < analysis->occurrencesEnd(p);
+         ++i)
+      QCOMPARE(analysis->occurrences()[i].end, p + 1);
+  }
+
+  // shared by retries, copies and texts loaded again by id.
+  QCOMPARE(text->analysis(false), analysis);
+  QCOMPARE(Text(*text).analysis(false), analysis);
+  QCOMPARE(Text("the quick fox", 7).analysis(false), analysis);
+  QVERIFY(Text("the quick fix", 7).analysis(false) != analysis);
+  QVERIFY(Text("the quick fox").analysis(false) != analysis);
+
+  // results keep pointing into the analysis after everything else is gone.
+  shared_ptr<TestResult> result;
+  {
+    Test test(make_shared<Text>("abcd", 8), true);
+    connect(&test, &Test::resultReady,
+            [&result](shared_ptr<TestResult> r) { result = r; });
+    test.start(0);
+    for (int i = 0; i < 4; ++i)
+      test.handleKeystroke(Keystroke{Keystroke::Type::Insert,
+                                     QChar('a' + i), i, (i + 1) * 100000000LL});
+  }
+  TextAnalysis::clearCache();
+  QVERIFY(result);
+  int abcd = result->ngrams.find(QStringRef(&result->text->text()));
+  QVERIFY(abcd >= 0);
+  QCOMPARE(result->ngrams.ngram(abcd).toString(), QString("abcd"));
+  QCOMPARE(result->ngrams.count(abcd), 1);
+  QCOMPARE(result->analysis, result->text->analysis(true));
+}
+
+void TestTests::testKeystrokes() {
+  auto text = make_shared<Text>("abc def");
+  Test test(text, true);
+  QSignalSpy resultSpy(&test, SIGNAL(resultReady(shared_ptr<TestResult>)));
+  // timestamps are set by the caller, so processing time doesn't count.
+  auto insert = [&test](QChar c, int position, int ms) {
+    test.handleKeystroke(
+        Keystroke{Keystroke::Type::Insert, c, position, ms * 1000000LL});
+  };
+
+  insert('x', 0, 0);  // ignored until the start key
+  QVERIFY(!test.started());
+  insert(' ', 0, 0);
+  QVERIFY(test.started());
+  int ms = 0;
+  for (int i = 0; i < 3; ++i) insert(text->text()[i], i, ms += 100);
+  insert('x', 3, ms += 100);
+  test.handleKeystroke(
+      Keystroke{Keystroke::Type::Erase, QChar(), 3, ms * 1000000LL});
+  for (int i = 3; i < text->text().length(); ++i)
+    insert(text->text()[i], i, ms += 100);
+
+  QCOMPARE(resultSpy.count(), 1);
+  auto result = qvariant_cast<shared_ptr<TestResult>>(resultSpy.at(0).at(0));
+  QCOMPARE(result->mistakes.size(), size_t(1));
+  QCOMPARE(result->mistakes.at(std::make_pair(QChar(' '), QChar('x'))), 1);
+  QCOMPARE(result->wpm, Test::wpm(text->text().length(), ms));
+}
+
+void TestTests::testRetypedStatistics() {
+  auto text = make_shared<Text>("abcde fghij");
+  Test test(text);
+  QSignalSpy spy(&test, SIGNAL(resultReady(shared_ptr<TestResult>)));
+  auto key = [&test](Keystroke::Type type, QChar c, int position, int ms) {
+    test.handleKeystroke(Keystroke{type, c, position, ms * 1000000LL});
+  };
+  key(Keystroke::Type::Insert, 'a', 0, 0);
+  key(Keystroke::Type::Insert, 'b', 1, 100);
+  key(Keystroke::Type::Insert, 'c', 2, 200);
+  // erase correct characters and type them again, slower.
+  key(Keystroke::Type::Erase, QChar(), 2, 300);
+  key(Keystroke::Type::Erase, QChar(), 1, 400);
+  key(Keystroke::Type::Insert, 'b', 1, 500);
+  key(Keystroke::Type::Insert, 'c', 2, 700);
+  for (int i = 3; i < text->text().length(); ++i)
+    key(Keystroke::Type::Insert, text->text()[i], i, 700 + (i - 2) * 100);
+
+  QCOMPARE(spy.count(), 1);
+  auto result = qvariant_cast<shared_ptr<TestResult>>(spy.at(0).at(0));
+  const auto& ngrams = result->ngrams;
+  const auto& typed = text->text();
+  int b = ngrams.find(QStringRef(&typed, 1, 1));
+  int c = ngrams.find(QStringRef(&typed, 2, 1));
+  int abc = ngrams.find(QStringRef(&typed, 0, 3));
+  int word = ngrams.find(QStringRef(&typed, 0, 5));
+  // only the last time a character was typed counts.
+  QCOMPARE(ngrams.count(b), 1);
+  QCOMPARE(ngrams.times(b)[0], 0.5);
+  QCOMPARE(ngrams.times(c)[0], 0.2);
+  QCOMPARE(ngrams.count(abc), 0);  // the first character has no time
+  QCOMPARE(ngrams.count(word), 1);
+  QCOMPARE(ngrams.times(word)[0], 0.225);
+  QCOMPARE(ngrams.mistakes(word), 0);
+}
+
+void TestTests::testKeystrokeLog() {
+  const qint64 ms = 1000000;
+  QString text("abc");
+  KeystrokeLog log(text);
+  log.insert(0, 'a');
+  log.insert(120 * ms, 'x');
+  log.erase(250 * ms);
+  log.insert(370 * ms, 'b');
+  log.insert(490 * ms, 'c');
+  QCOMPARE(log.size(), 5);
+
+  auto events = KeystrokeLog::decode(log.data(), text);
+  QCOMPARE(events.size(), size_t(5));
+  QVERIFY(events[0].type == KeystrokeLog::Event::Type::Correct);
+  QCOMPARE(events[0].character, QChar('a'));
+  QVERIFY(events[1].type == KeystrokeLog::Event::Type::Mistake);
+  QCOMPARE(events[1].character, QChar('x'));
+  QCOMPARE(events[1].position, 1);
+  QVERIFY(events[2].type == KeystrokeLog::Event::Type::Erase);
+  QCOMPARE(events[2].position, 1);
+  QCOMPARE(events[3].character, QChar('b'));
+  QCOMPARE(events[3].position, 1);
+  QCOMPARE(events[4].ms, qint64(490));
+  QCOMPARE(KeystrokeLog::flags(log.data()), 0);
+  KeystrokeLog spaced(text, KeystrokeLog::RequireSpace);
+  spaced.insert(0, 'a');
+  QCOMPARE(KeystrokeLog::flags(spaced.data()), int(KeystrokeLog::RequireSpace));
+  QCOMPARE(KeystrokeLog::decode(spaced.data(), text).size(), size_t(1));
+
+  // logs from before releases had their own stream still decode.
+  events = KeystrokeLog::decode(QByteArray::fromHex("02000350"), text);
+  QCOMPARE(events.size(), size_t(2));
+  QVERIFY(events[1].type == KeystrokeLog::Event::Type::Release);
+  QCOMPARE(events[1].press, 0);
+  QCOMPARE(events[1].ms, qint64(80));
+  QCOMPARE(KeystrokeLog::flags(QByteArray::fromHex("02000350")), -1);
+
+  // a whole test is logged and saved with its result.
+  auto passage =
+      make_shared<Text>(QString("the quick brown fox ").repeated(50));
+  Test test(passage);
+  QSignalSpy spy(&test, SIGNAL(resultReady(shared_ptr<TestResult>)));
+  for (int i = 0; i < passage->text().length(); ++i) {
+    test.handleKeystroke(Keystroke{Keystroke::Type::Insert,
+                                   passage->text()[i], i,
+                                   (i * 150 + (i % 3) * 10) * ms});
+  }
+  QCOMPARE(spy.count(), 1);
+  auto result = qvariant_cast<shared_ptr<TestResult>>(spy.at(0).at(0));
+
+  Database db(":memory:");
+  db.initDB();
+  db.addResult(result.get());
+  auto id = db.getOneRow("SELECT max(id) FROM result")[0].toInt();
+  auto saved = db.getKeystrokeLog(id);
+  QCOMPARE(saved, result->keystrokes);
+  events = KeystrokeLog::decode(saved, passage->text());
+  QCOMPARE(events.size(), size_t(passage->text().length()));
+  QCOMPARE(events.back().ms, qint64((events.size() - 1) * 150 +
+                                    ((events.size() - 1) % 3) * 10));
+}
+
+void TestTests::testKeystrokeLogSize() {
+  // about 80 wpm with the spread of real typing: intervals of 150 ms give or
+  // take about 40, keys held for 90 ms give or take about 20 and a mistake
+  // corrected every 50 keys.
+  const int kKeys = 1000;
+  const qint64 ms = 1000000;
+  QString text = QString("the quick brown fox ").repeated(kKeys / 20);
+  auto type = [&text, ms](bool releases) {
+    quint32 seed = 1;
+    auto jitter = [&seed](int range) {
+      seed = seed * 1103515245u + 12345u;
+      return static_cast<int>((seed >> 16) % (2 * range + 1)) - range;
+    };
+    KeystrokeLog log(text);
+    // (released, pressed, keystroke) of the keys held down.
+    std::vector<std::array<qint64, 3>> held;
+    auto releaseUntil = [&log, &held, ms](qint64 until) {
+      std::sort(held.begin(), held.end());
+      auto it = held.begin();
+      for (; it != held.end() && (*it)[0] <= until; ++it) {
+        log.release(log.size() - 1 - static_cast<int>((*it)[2]),
+                    ((*it)[0] - (*it)[1]) * ms);
+      }
+      held.erase(held.begin(), it);
+    };
+    qint64 t = 0;
+    auto press = [&](const std::function<void(qint64)>& key) {
+      t += 150 + jitter(40) + jitter(40) + jitter(40);
+      if (releases) releaseUntil(t);
+      int keystroke = log.size();
+      key(t * ms);
+      if (releases)
+        held.push_back({{t + 90 + jitter(25) + jitter(25), t, keystroke}});
+    };
+    for (int i = 0; i < kKeys; ++i) {
+      if (i % 50 == 25) {
+        press([&log](qint64 ns) { log.insert(ns, '#'); });
+        press([&log](qint64 ns) { log.erase(ns); });
+      }
+      press([&log, &text, i](qint64 ns) { log.insert(ns, text[i]); });
+    }
+    if (releases) releaseUntil(std::numeric_limits<qint64>::max());
+    return log;
+  };
+
+  auto log = type(false);
+  QCOMPARE(log.size(), kKeys + 2 * (kKeys / 50));
+  QVERIFY(log.data().size() < 2 * log.size());
+  QCOMPARE(KeystrokeLog::decode(log.data(), text).size(),
+           static_cast<size_t>(log.size()));
+  int presses = log.pressBytes();
+
+  // releases go in their own stream, about a byte each, and leave the
+  // keystrokes as they were.
+  log = type(true);
+  QCOMPARE(log.pressBytes(), presses);
+  QVERIFY(log.data().size() < 3 * log.size());
+  auto events = KeystrokeLog::decode(log.data(), text);
+  QCOMPARE(events.size(), static_cast<size_t>(2 * log.size()));
+  // each release comes after its keystroke.
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (events[i].type == KeystrokeLog::Event::Type::Release)
+      QVERIFY(events[i].press < static_cast<int>(i));
+  }
+}
+
+void TestTests::testKeyTimings() {
+  auto text = make_shared<Text>("abab");
+  Test test(text);
+  QSignalSpy spy(&test, SIGNAL(resultReady(shared_ptr<TestResult>)));
+  auto key = [&test](Keystroke::Type type, QChar c, int position, int ms) {
+    test.handleKeystroke(
+        Keystroke{type, c, position, ms * 1000000LL, c.unicode()});
+  };
+  // a and b are held for 80 ms, b is pressed 20 ms after a is released and
+  // a 30 ms before b is released.
+  key(Keystroke::Type::Insert, 'a', 0, 0);
+  key(Keystroke::Type::Release, 'a', 0, 80);
+  key(Keystroke::Type::Insert, 'b', 1, 100);
+  key(Keystroke::Type::Insert, 'a', 2, 150);
+  key(Keystroke::Type::Release, 'b', 0, 180);
+  key(Keystroke::Type::Release, 'a', 0, 230);
+  key(Keystroke::Type::Insert, 'b', 3, 250);
+
+  QCOMPARE(spy.count(), 1);
+  auto result = qvariant_cast<shared_ptr<TestResult>>(spy.at(0).at(0));
+  const auto& timings = result->key_timings;
+  QCOMPARE(timings.at("a").count, 2);
+  QCOMPARE(timings.at("a").dwell, 80.0);
+  // the last b was never released before the test finished.
+  QCOMPARE(timings.at("b").count, 1);
+  QCOMPARE(timings.at("b").dwell, 80.0);
+  QCOMPARE(timings.at("ab").count, 2);
+  QCOMPARE(timings.at("ab").flight, 20.0);
+  QCOMPARE(timings.at("ba").flight, -30.0);
+  QCOMPARE(timings.at("ba").overlaps, 1);
+
+  // the releases are logged, and replaying them gives the same timings.
+  auto events = KeystrokeLog::decode(result->keystrokes, text->text());
+  QCOMPARE(events.size(), size_t(7));
+  QVERIFY(events[4].type == KeystrokeLog::Event::Type::Release);
+  QCOMPARE(events[4].press, 2);
+  QCOMPARE(events[4].position, 1);
+  QCOMPARE(events[4].ms, qint64(180));
+  QCOMPARE(events[5].press, 3);
+  QVERIFY(result->keystrokes.size() < 2 + 3 * 7);
+  auto replayed = replay::run(text, result->keystrokes);
+  QVERIFY(replayed);
+  QCOMPARE(replayed->key_timings.at("ba").flight, -30.0);
+  QCOMPARE(replayed->key_timings.at("b").dwell, 80.0);
+
+  // and they're saved with the result.
+  Database db(":memory:");
+  db.initDB();
+  db.addResult(result.get());
+  auto saved = db.getKeyTimings(result->id);
+  QCOMPARE(saved.size(), timings.size());
+  QCOMPARE(saved.at("ab").flight, 20.0);
+  QCOMPARE(saved.at("ba").overlaps, 1);
+  QCOMPARE(saved.at("a").dwell, 80.0);
+  db.deleteResult(QList<int>() << static_cast<int>(result->id));
+  QVERIFY(db.getKeyTimings(result->id).empty());
+}
+
+void TestTests::testReplay() {
+  Database db(":memory:");
+  db.initDB();
+  QString passage("the quick brown fox jumps over the lazy dog");
+  int source = db.getSource("replay");
+  db.addText(source, passage);
+  int id = db.getOneRow("SELECT id FROM text")[0].toInt();
+  auto text = make_shared<Text>(passage, id, source);
+
+  Test test(text);
+  QSignalSpy spy(&test, SIGNAL(resultReady(shared_ptr<TestResult>)));
+  qint64 ns = 0;
+  for (int i = 0; i < passage.length(); ++i) {
+    if (i == 10) {
+      test.handleKeystroke(Keystroke{Keystroke::Type::Insert, 'x', i, ns});
+      test.handleKeystroke(
+          Keystroke{Keystroke::Type::Erase, QChar(), i, ns += 90000000});
+    }
+    test.handleKeystroke(
+        Keystroke{Keystroke::Type::Insert, passage[i], i, ns});
+    ns += (100 + i % 4 * 20) * 1000000LL;
+  }
+  QCOMPARE(spy.count(), 1);
+  auto result = qvariant_cast<shared_ptr<TestResult>>(spy.at(0).at(0));
+  db.addResult(result.get());
+  db.addStatistics(result.get());
+  db.addMistakes(result.get());
+
+  QString statistics =
+      "SELECT w, ngram, time, count, mistakes, viscosity FROM statistic "
+      "ORDER BY ngram";
+  auto saved = db.getRows(statistics);
+  auto mistakes = db.getRows("SELECT * FROM mistake");
+  QVERIFY(!saved.empty());
+  QCOMPARE(mistakes.size(), size_t(1));
+  db.bindAndRun("UPDATE statistic SET time = 0");
+  db.bindAndRun("DELETE FROM mistake");
+  db.bindAndRun("UPDATE result SET wpm = 0");
+
+  QCOMPARE(replay::replayProfile(&db), 1);
+  QCOMPARE(db.getRows(statistics), saved);
+  QCOMPARE(db.getRows("SELECT * FROM mistake"), mistakes);
+  QCOMPARE(db.getOneRow("SELECT wpm FROM result")[0].toDouble(), result->wpm);
+
+  // another result saved at the same time keeps its statistics.
+  db.bindAndRun(
+      "INSERT INTO result (w, text_id, source, wpm, accuracy, viscosity) "
+      "SELECT w, text_id, source, 1, 1, 1 FROM result");
+  int other = db.getOneRow("SELECT max(id) FROM result")[0].toInt();
+  db.bindAndRun(
+      "INSERT INTO statistic "
+      "(w, ngram, time, count, mistakes, viscosity, result_id) "
+      "SELECT w, ngram, 1, 1, 0, 1, ? FROM statistic LIMIT 1",
+      other);
+  QCOMPARE(replay::replayProfile(&db), 1);
+  QString linked = "SELECT count() FROM statistic WHERE result_id = ?";
+  QCOMPARE(db.getOneRow(linked, other)[0].toInt(), 1);
+  QCOMPARE(db.getOneRow(linked, result->id)[0].toInt(),
+           static_cast<int>(saved.size()));
+
+  // lessons don't save statistics, so they aren't replaced either.
+  db.bindAndRun("UPDATE source SET type = ?",
+                static_cast<int>(amphetype::text_type::Lesson));
+  db.bindAndRun("UPDATE statistic SET time = 0");
+  db.bindAndRun("DELETE FROM mistake");
+  QCOMPARE(replay::replayProfile(&db), 1);
+  QCOMPARE(db.getOneRow("SELECT max(time) FROM statistic")[0].toDouble(),
+           0.0);
+  QCOMPARE(db.getRows("SELECT * FROM mistake"), mistakes);
+
+  // compressed statistics can't be told apart, the result is left alone.
+  db.bindAndRun("UPDATE source SET type = ?",
+                static_cast<int>(amphetype::text_type::Standard));
+  db.bindAndRun(
+      "UPDATE statistic SET w = '2000-01-01', result_id = NULL "
+      "WHERE result_id = ?",
+      result->id);
+  db.bindAndRun("UPDATE result SET wpm = 0");
+  QCOMPARE(replay::replayProfile(&db), 1);
+  QCOMPARE(db.getOneRow("SELECT wpm FROM result WHERE id = ?",
+                        result->id)[0].toDouble(),
+           0.0);
+  QCOMPARE(db.getOneRow("SELECT count() FROM statistic")[0].toInt(),
+           static_cast<int>(saved.size()) + 1);
+}
+
+void TestTests::testSpscRing() {
+  SpscRing<int, 4> ring;
+  int value;
+  QVERIFY(!ring.pop(&value));
+  for (int i = 0; i < 4; ++i) QVERIFY(ring.push(i));
+  QVERIFY(!ring.push(4));
+  QCOMPARE(ring.size(), size_t(4));
+  QVERIFY(ring.pop(&value));
+  QCOMPARE(value, 0);
+
+  // values arrive in order from another thread.
+  static SpscRing<int, 64> shared;
+  const int count = 100'000;
+  std::thread producer([] {
+    for (int i = 0; i < count; ++i)
+      while (!shared.push(i)) std::this_thread::yield();
+  });
+  bool ordered = true;
+  for (int expected = 0; expected < count;) {
+    if (!shared.pop(&value)) continue;
+    ordered = ordered && value == expected;
+    ++expected;
+  }
+  producer.join();
+  QVERIFY(ordered);
+}
+
+void TestTests::testRunnerWakeup() {
+  Test test(make_shared<Text>("abcdef"));
+  TestRunner runner;
+  QSignalSpy spy(&runner, SIGNAL(updatesReady()));
+  runner.setTest(&test);
+  runner.start();
+  for (int i = 0; i < 3; ++i)
+    runner.post(Keystroke{Keystroke::Type::Insert, QChar('a' + i), i, -1});
+  QTRY_COMPARE(runner.stats().keystrokes, quint64(3));
+  // a burst of updates wakes the GUI thread once.
+  QCOMPARE(spy.count(), 1);
+  DisplayUpdate update;
+  int updates = 0;
+  while (runner.takeUpdate(&update)) ++updates;
+  QVERIFY(updates >= 3);
+  // the next update after the ring was drained wakes it again.
+  runner.post(Keystroke{Keystroke::Type::Insert, QChar('d'), 3, -1});
+  QTRY_COMPARE(spy.count(), 2);
+  QCOMPARE(runner.stats().dropped_updates, quint64(0));
+  runner.setTest(Q_NULLPTR);
+
+  // updates the GUI doesn't take in time are counted when they're dropped.
+  Test busy(make_shared<Text>(QString(3000, 'a')));
+  runner.setTest(&busy);
+  runner.resetStats();
+  for (int i = 0; i < 2000; ++i) {
+    runner.post(Keystroke{Keystroke::Type::Insert, QChar('a'), i, -1});
+    if (i % 500 == 499) QTRY_COMPARE(runner.stats().keystrokes, quint64(i + 1));
+  }
+  QCOMPARE(runner.stats().dropped, quint64(0));
+  QVERIFY(runner.stats().dropped_updates > 0);
+  runner.setTest(Q_NULLPTR);
+}
+
+void TestTests::testLatencyHistogram() {
+  LatencyHistogram histogram;
+  QCOMPARE(histogram.percentile(0.5), qint64(0));
+  for (int us = 1; us <= 1000; ++us) histogram.record(us * 1000);
+  QCOMPARE(histogram.count(), quint64(1000));
+  QCOMPARE(histogram.max(), qint64(1000000));
+  // buckets are within 12.5% of the latencies in them.
+  auto p50 = histogram.percentile(0.5);
+  QVERIFY(p50 >= 500000 && p50 <= 562500);
+  auto p99 = histogram.percentile(0.99);
+  QVERIFY(p99 >= 990000 && p99 <= 1000000);
+  QCOMPARE(histogram.percentile(1.0), qint64(1000000));
+  histogram.reset();
+  QCOMPARE(histogram.count(), quint64(0));
+}
+
+void TestTests::benchmarkTyping_data() {
+  QTest::addColumn<int>("length");
+  QTest::newRow("1k") << 1'000;
+  QTest::newRow("10k") << 10'000;
+  QTest::newRow("100k") << 100'000;
+}
+
+void TestTests::benchmarkTyping() {
+  QFETCH(int, length);
+  QString sentence("the quick brown fox jumps over the lazy dog. ");
+  QString passage;
+  while (passage.length() < length) passage += sentence;
+  auto text = make_shared<Text>(passage.left(length));
+
+  QBENCHMARK {
+    Test test(text);
+    // everything but the last key, which would finish the test.
+    for (int i = 0; i < length - 1; ++i) {
+      qint64 ns = i * 100 * 1000000LL;
+      if (i % 100 == 50) {  // a mistake and its correction
+        test.handleKeystroke(
+            Keystroke{Keystroke::Type::Insert, '#', i, ns});
+        test.handleKeystroke(
+            Keystroke{Keystroke::Type::Erase, QChar(), i, ns});
+      }
+      test.handleKeystroke(
+          Keystroke{Keystroke::Type::Insert, text->text()[i], i, ns});
+    }
+  }
+}
+
+void TestTests::testSaveResult() {
+  auto text = make_shared<Text>("the quick brown fox");
+  Test test(text);
+  QSignalSpy spy(&test, SIGNAL(resultReady(shared_ptr<TestResult>)));
+  qint64 ns = 0;
+  test.handleKeystroke(Keystroke{Keystroke::Type::Insert, 'x', 0, ns});
+  test.handleKeystroke(
+      Keystroke{Keystroke::Type::Erase, QChar(), 0, ns += 100000000});
+  for (int i = 0; i < text->text().length(); ++i) {
+    test.handleKeystroke(Keystroke{Keystroke::Type::Insert, text->text()[i],
+                                   i, ns += 100000000});
+  }
+  QCOMPARE(spy.count(), 1);
+  auto result = qvariant_cast<shared_ptr<TestResult>>(spy.at(0).at(0));
+
+  Database db(":memory:");
+  db.initDB();
+  db.saveResult(result.get());
+  auto count = [&db](const QString& table) {
+    return db.getOneRow("SELECT count() FROM " + table)[0].toInt();
+  };
+  QCOMPARE(count("result"), 1);
+  QCOMPARE(count("keystroke_log"), 1);
+  QCOMPARE(count("mistake"), 1);
+  QVERIFY(count("statistic") > 0);
+  auto w = db.getOneRow("SELECT w FROM result")[0];
+  QCOMPARE(db.getOneRow("SELECT count() FROM statistic WHERE w != ?",
+                        db_row{w})[0].toInt(), 0);
+
+  // a row that can't be saved undoes the whole result.
+  int statistics = count("statistic");
+  db.bindAndRun(
+      "CREATE TRIGGER no_mistakes BEFORE INSERT ON mistake "
+      "BEGIN SELECT RAISE(ABORT, 'no mistakes'); END");
+  db.saveResult(result.get());
+  QCOMPARE(count("result"), 1);
+  QCOMPARE(count("keystroke_log"), 1);
+  QCOMPARE(count("statistic"), statistics);
+  QCOMPARE(count("mistake"), 1);
+}
+
+void TestTests::testReviews() {
+  auto text = make_shared<Text>("the quick brown fox");
+  Test test(text);
+  QSignalSpy spy(&test, SIGNAL(resultReady(shared_ptr<TestResult>)));
+  qint64 ns = 0;
+  for (int i = 0; i < text->text().length(); ++i) {
+    // the first letter of "quick" is mistyped once.
+    if (i == 4) {
+      test.handleKeystroke(
+          Keystroke{Keystroke::Type::Insert, 'x', i, ns += 100000000});
+      test.handleKeystroke(
+          Keystroke{Keystroke::Type::Erase, QChar(), i, ns += 100000000});
+    }
+    test.handleKeystroke(Keystroke{Keystroke::Type::Insert, text->text()[i],
+                                   i, ns += 100000000});
+  }
+  QCOMPARE(spy.count(), 1);
+  auto result = qvariant_cast<shared_ptr<TestResult>>(spy.at(0).at(0));
+
+  Database db(":memory:");
+  db.initDB();
+  db.saveResult(result.get());
+  // only the word with a mistake is scheduled, "brown" was typed fine.
+  QCOMPARE(db.getOneRow("SELECT count() FROM review")[0].toInt(), 1);
+  auto schedule = db.reviewSchedule();
+  QCOMPARE(schedule->size(), 1);
+  // a lapse is due again in a few minutes, not before.
+  qint64 now = result->when.toMSecsSinceEpoch() / 1000;
+  QVERIFY(schedule->next(10, now).isEmpty());
+  QCOMPARE(schedule->next(10, now + 600), QStringList() << "quick");
+  auto row = db.getOneRow("SELECT lapses, reps FROM review");
+  QCOMPARE(row[0].toInt(), 1);
+  QCOMPARE(row[1].toInt(), 0);
+
+  // nothing is due yet, so the drill is of the most damaging words.
+  auto drill = db.textFromReviews(1, 20);
+  QVERIFY(drill->text().contains("quick"));
+  QCOMPARE(drill->nextTextSelectionPreference(),
+           amphetype::SelectionMethod::SpacedRepetition);
+
+  // reviews are kept up to date as statistics are saved.
+  db.addStatistics(result.get());
+  QCOMPARE(db.getOneRow("SELECT lapses FROM review")[0].toInt(), 2);
+  QVERIFY(schedule->loaded());
+  db.deleteStatistic("quick");
+  QCOMPARE(db.reviewSchedule()->size(), 0);
+}
+
+void TestTests::testTextStatistics() {
+  auto text = make_shared<Text>("the quick brown fox");
+  Test test(text);
+  QSignalSpy spy(&test, SIGNAL(resultReady(shared_ptr<TestResult>)));
+  qint64 ns = 0;
+  for (int i = 0; i < text->text().length(); ++i) {
+    if (i == 4) {
+      test.handleKeystroke(
+          Keystroke{Keystroke::Type::Insert, 'x', i, ns += 100000000});
+      test.handleKeystroke(
+          Keystroke{Keystroke::Type::Erase, QChar(), i, ns += 100000000});
+    }
+    test.handleKeystroke(Keystroke{Keystroke::Type::Insert, text->text()[i],
+                                   i, ns += 100000000});
+  }
+  QCOMPARE(spy.count(), 1);
+  auto result = qvariant_cast<shared_ptr<TestResult>>(spy.at(0).at(0));
+
+  Database db(":memory:");
+  db.initDB();
+  QVERIFY(db.textStatistics(*text).isEmpty());
+  db.saveResult(result.get());
+
+  const int keys = static_cast<int>(amphetype::statistics::Type::Keys);
+  const int trigrams = static_cast<int>(amphetype::statistics::Type::Trigrams);
+  const int words = static_cast<int>(amphetype::statistics::Type::Words);
+  auto statistics = db.textStatistics(Text("a quick jumping fox"));
+  QVERIFY(statistics.contains(qMakePair(words, QString("quick"))));
+  auto quick = statistics[qMakePair(words, QString("quick"))];
+  QCOMPARE(quick.count, 1);
+  QCOMPARE(quick.mistakes, 1);
+  auto o = statistics[qMakePair(keys, QString("o"))];
+  QCOMPARE(o.count, 2);
+  QCOMPARE(o.wpm, 120.0);
+  QVERIFY(statistics.contains(qMakePair(trigrams, QString("fox"))));
+  // ngrams that were never typed have no statistics.
+  QVERIFY(!statistics.contains(qMakePair(keys, QString("a"))));
+  QVERIFY(!statistics.contains(qMakePair(trigrams, QString("jum"))));
+  QVERIFY(!statistics.contains(qMakePair(words, QString("jumping"))));
+  // the temporary table is refilled for every text.
+  QVERIFY(db.textStatistics(Text("jumping")).isEmpty());
+}
+
+void TestTests::benchmarkTextStatistics() {
+  // the statistics of a 1000 character text, looked up as it's loaded.
+  const int kLength = 1'000;
+  QString sentence("the quick brown fox jumps over the lazy dog. ");
+  QString passage;
+  while (passage.length() < kLength) passage += sentence;
+  auto text = make_shared<Text>(passage.left(kLength));
+  Test test(text);
+  QSignalSpy spy(&test, SIGNAL(resultReady(shared_ptr<TestResult>)));
+  qint64 ns = 0;
+  for (int i = 0; i < kLength; ++i) {
+    test.handleKeystroke(Keystroke{Keystroke::Type::Insert, text->text()[i],
+                                   i, ns += 100000000});
+  }
+  QCOMPARE(spy.count(), 1);
+  auto result = qvariant_cast<shared_ptr<TestResult>>(spy.at(0).at(0));
+
+  Database db(":memory:");
+  db.initDB();
+  for (int i = 0; i < 100; ++i) db.addStatistics(result.get());
+
+  ngram_statistics statistics;
+  QBENCHMARK { statistics = db.textStatistics(*text); }
+  const int words = static_cast<int>(amphetype::statistics::Type::Words);
+  QCOMPARE(statistics[qMakePair(words, QString("quick"))].count,
+           100 * text->text().count("quick"));
+}
+
+void TestTests::benchmarkFinish_data() {
+  QTest::addColumn<int>("length");
+  QTest::newRow("1k") << 1'000;
+  QTest::newRow("10k") << 10'000;
+}
+
+void TestTests::benchmarkFinish() {
+  // from the last keystroke to the result being committed.
+  QFETCH(int, length);
+  const int kRuns = 20;
+  QString sentence("the quick brown fox jumps over the lazy dog. ");
+  QString passage;
+  while (passage.length() < length) passage += sentence;
+  auto text = make_shared<Text>(passage.left(length));
+  Database db(":memory:");
+  db.initDB();
+
+  qint64 total = 0;
+  for (int run = 0; run < kRuns; ++run) {
+    Test test(text);
+    bool saved = false;
+    connect(&test, &Test::resultReady,
+            [&db, &saved](shared_ptr<TestResult> result) {
+              db.saveResult(result.get());
+              saved = true;
+            });
+    qint64 ns = 0;
+    for (int i = 0; i < length - 1; ++i) {
+      if (i % 100 == 50) {
+        test.handleKeystroke(Keystroke{Keystroke::Type::Insert, '#', i, ns});
+        test.handleKeystroke(
+            Keystroke{Keystroke::Type::Erase, QChar(), i, ns});
+      }
+      test.handleKeystroke(Keystroke{Keystroke::Type::Insert,
+                                     text->text()[i], i, ns += 100000000});
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    test.handleKeystroke(Keystroke{Keystroke::Type::Insert,
+                                   text->text()[length - 1], length - 1,
+                                   ns += 100000000});
+    total += timer.nsecsElapsed();
+    QVERIFY(saved);
+  }
+  QTest::setBenchmarkResult(total / 1e6 / kRuns,
+                            QTest::WalltimeMilliseconds);
+}
+
 void TestTests::testRequireSpace() {
   auto text = make_shared<Text>("abcde fghij klmno pqrst uvwxy");
   Test test(text, true);
@@ -48,12 +830,15 @@ void TestTests::testRequireSpace() {
   QCOMPARE(spy.count(), 1);
   
   auto result = qvariant_cast<shared_ptr<TestResult>>(spy.at(0).at(0));
+  // replays are typed the same way.
+  QCOMPARE(KeystrokeLog::flags(result->keystrokes),
+           int(KeystrokeLog::RequireSpace));
 
   Database db(":memory:");
   db.initDB();
   db.addStatistics(result.get());
   std::vector<double> visc;
-  auto db_words = db.getRows("select * from statistic where type = 2");
+  auto db_words = db.getRows("select * from statisticView where type = 2");
   for (const auto& row : db_words) visc.push_back(row[6].toDouble());
   auto visc_set = std::set<double>(visc.begin(), visc.end());
   QVERIFY(visc_set.size() == 1);
@@ -81,7 +866,7 @@ void TestTests::testViscosity() {
   db.initDB();
   db.addStatistics(result.get());
   std::vector<double> visc;
-  auto db_words = db.getRows("select * from statistic where type = 2");
+  auto db_words = db.getRows("select * from statisticView where type = 2");
   for (const auto& row : db_words) visc.push_back(row[6].toDouble());
   auto visc_set = std::set<double>(visc.begin(), visc.end());
   QVERIFY(visc_set.size() == 2);
@@ -143,7 +928,7 @@ void TestTests::testStatistics() {
   db.initDB();
   db.addStatistics(result.get());
 
-  auto db_words = db.getRows("select * from statistic where type = 2");
+  auto db_words = db.getRows("select * from statisticView where type = 2");
 
   for (const auto& row : db_words) {
     auto data = row[1].toString();
@@ -157,7 +942,7 @@ void TestTests::testStatistics() {
     QCOMPARE(time, expected_word_avg);
   }
 
-  auto db_chars = db.getRows("select * from statistic where type = 0");
+  auto db_chars = db.getRows("select * from statisticView where type = 0");
   for (const auto& row : db_chars) {
     auto data = row[1].toString();
     auto time = row[3].toDouble();